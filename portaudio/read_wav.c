@@ -0,0 +1,435 @@
+/**
+  * Zero-copy WAV file reader, the counterpart to write_wav.c.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "read_wav.h"
+
+
+/* Read long word data from a little endian format byte array. */
+static unsigned long ReadLongLE( const unsigned char *addr )
+{
+	return (unsigned long) addr[0] |
+		((unsigned long) addr[1] << 8) |
+		((unsigned long) addr[2] << 16) |
+		((unsigned long) addr[3] << 24);
+}
+
+/* Read 64-bit data from a little endian format byte array. */
+static long long ReadLongLongLE( const unsigned char *addr )
+{
+	return (long long) ReadLongLE( addr ) | ((long long) ReadLongLE( addr + 4 ) << 32);
+}
+
+/* Read short word data from a little endian format byte array. */
+static unsigned short ReadShortLE( const unsigned char *addr )
+{
+	return (unsigned short) (addr[0] | (addr[1] << 8));
+}
+
+/* Read IFF ChunkType data from a byte array. */
+static unsigned long ReadChunkType( const unsigned char *addr )
+{
+	return ((unsigned long) addr[0] << 24) |
+		((unsigned long) addr[1] << 16) |
+		((unsigned long) addr[2] << 8) |
+		(unsigned long) addr[3];
+}
+
+/* Parse a format chunk body. */
+static long ParseFormat( WAV_Reader *reader, const unsigned char *body, unsigned long size )
+{
+    int format = ReadShortLE( body );
+    int bitsPerSample = ReadShortLE( body + 14 );
+
+    reader->samplesPerFrame = ReadShortLE( body + 2 );
+    reader->frameRate = (int) ReadLongLE( body + 4 );
+    reader->bytesPerFrame = ReadShortLE( body + 12 );
+
+    /* The actual format of extensible headers is in the sub format GUID. */
+    if( format == WAVE_FORMAT_EXTENSIBLE )
+    {
+        if( size < 40 ) return WAV_ERR_CHUNK_SIZE;
+        format = ReadShortLE( body + 24 );
+    }
+
+    if( format == WAVE_FORMAT_PCM && bitsPerSample == 16 )
+    {
+        reader->sampleType = WAV_SAMPLE_INT16;
+    }
+    else if( format == WAVE_FORMAT_PCM && bitsPerSample == 24 )
+    {
+        reader->sampleType = WAV_SAMPLE_INT24;
+    }
+    else if( format == WAVE_FORMAT_IEEE_FLOAT && bitsPerSample == 32 )
+    {
+        reader->sampleType = WAV_SAMPLE_FLOAT32;
+    }
+    else if( format == WAVE_FORMAT_PCM || format == WAVE_FORMAT_IEEE_FLOAT )
+    {
+        return WAV_ERR_ILLEGAL_VALUE;
+    }
+    else
+    {
+        return WAV_ERR_FORMAT_TYPE;
+    }
+
+    if( reader->samplesPerFrame < 1 || reader->frameRate < 1 ||
+        reader->bytesPerFrame != reader->samplesPerFrame * (bitsPerSample / 8) )
+    {
+        return WAV_ERR_ILLEGAL_VALUE;
+    }
+    return 0;
+}
+
+/*********************************************************************************
+ * Parse a WAV file image already in memory. The reader points into the image,
+ * which has to outlive it.
+ * Returns zero or negative error code.
+ */
+long Audio_WAV_ParseImage( WAV_Reader *reader, const unsigned char *image, long long imageSize )
+{
+    unsigned long formType;
+    long long pos;
+    long long ds64DataSize = -1;
+    int haveFormat = 0;
+    long result;
+
+    reader->image = image;
+    reader->imageSize = imageSize;
+    reader->sampleType = 0;
+    reader->data = NULL;
+    reader->numFrames = 0;
+    reader->truncated = 0;
+    reader->timeReference = 0;
+
+    if( imageSize < 12 ) return WAV_ERR_TRUNCATED;
+    formType = ReadChunkType( image );
+    if( (formType != RIFF_ID && formType != RF64_ID) || ReadChunkType( image + 8 ) != WAVE_ID )
+    {
+        return WAV_ERR_FILE_TYPE;
+    }
+
+    /* Walk the chunks up to the data chunk. */
+    pos = 12;
+    while( pos + 8 <= imageSize )
+    {
+        unsigned long chunkType = ReadChunkType( image + pos );
+        unsigned long chunkSize = ReadLongLE( image + pos + 4 );
+        const unsigned char *body = image + pos + 8;
+        long long available = imageSize - (pos + 8);
+
+        if( chunkType == DATA_ID )
+        {
+            long long dataSize = chunkSize;
+            if( !haveFormat ) return WAV_ERR_FILE_TYPE;
+
+            /* RF64 keeps the real size in the ds64 chunk. */
+            if( formType == RF64_ID && chunkSize == 0xFFFFFFFF )
+            {
+                if( ds64DataSize < 0 ) return WAV_ERR_CHUNK_SIZE;
+                dataSize = ds64DataSize;
+            }
+
+            /* A size of zero with data following is a header that was never
+             * finalized. Either way, recover the frames that are present. */
+            if( (dataSize == 0 && available > 0) || dataSize > available )
+            {
+                dataSize = available;
+                reader->truncated = 1;
+            }
+            if( dataSize % reader->bytesPerFrame )
+            {
+                reader->truncated = 1;
+            }
+            reader->data = body;
+            reader->numFrames = dataSize / reader->bytesPerFrame;
+            return 0;
+        }
+
+        if( (long long) chunkSize > available ) return WAV_ERR_CHUNK_SIZE;
+
+        if( chunkType == FMT_ID )
+        {
+            if( chunkSize < 16 ) return WAV_ERR_CHUNK_SIZE;
+            result = ParseFormat( reader, body, chunkSize );
+            if( result < 0 ) return result;
+            haveFormat = 1;
+        }
+        else if( chunkType == DS64_ID )
+        {
+            if( chunkSize < 24 ) return WAV_ERR_CHUNK_SIZE;
+            ds64DataSize = ReadLongLongLE( body + 8 );
+            if( ds64DataSize < 0 ) return WAV_ERR_ILLEGAL_VALUE;
+        }
+        else if( chunkType == BEXT_ID )
+        {
+            /* TimeReference follows the text fields */
+            if( chunkSize < 346 ) return WAV_ERR_CHUNK_SIZE;
+            reader->timeReference = (unsigned long long) ReadLongLongLE( body + 338 );
+        }
+
+        /* Chunks are padded to an even size. */
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    /* File ends before the data chunk. */
+    return WAV_ERR_TRUNCATED;
+}
+
+/*********************************************************************************
+ * Map named file into memory and parse it.
+ * Returns zero or negative error code.
+ */
+long Audio_WAV_OpenReader( WAV_Reader *reader, const char *fileName )
+{
+    const unsigned char *image;
+    long long imageSize;
+    long result;
+
+    memset( reader, 0, sizeof(*reader) );
+
+#ifdef _WIN32
+    {
+        LARGE_INTEGER size;
+        HANDLE file = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+        if( file == INVALID_HANDLE_VALUE ) return -1;
+        if( !GetFileSizeEx( file, &size ) )
+        {
+            CloseHandle( file );
+            return -1;
+        }
+        if( size.QuadPart == 0 )
+        {
+            CloseHandle( file );
+            return WAV_ERR_TRUNCATED;
+        }
+        HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+        if( mapping == NULL )
+        {
+            CloseHandle( file );
+            return -1;
+        }
+        image = (const unsigned char *) MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+        if( image == NULL )
+        {
+            CloseHandle( mapping );
+            CloseHandle( file );
+            return -1;
+        }
+        imageSize = size.QuadPart;
+        reader->fileHandle = file;
+        reader->mappingHandle = mapping;
+    }
+#else
+    {
+        struct stat st;
+        void *p;
+        int fd = open( fileName, O_RDONLY );
+        if( fd < 0 ) return -1;
+        if( fstat( fd, &st ) < 0 )
+        {
+            close( fd );
+            return -1;
+        }
+        if( st.st_size == 0 )
+        {
+            close( fd );
+            return WAV_ERR_TRUNCATED;
+        }
+        p = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        /* The mapping stays valid without the descriptor. */
+        close( fd );
+        if( p == MAP_FAILED ) return -1;
+        madvise( p, st.st_size, MADV_SEQUENTIAL );
+        image = (const unsigned char *) p;
+        imageSize = st.st_size;
+    }
+#endif
+
+    reader->isMapped = 1;
+    result = Audio_WAV_ParseImage( reader, image, imageSize );
+    if( result < 0 )
+    {
+        Audio_WAV_CloseReader( reader );
+    }
+    return result;
+}
+
+/*********************************************************************************
+ * Unmap the file, if the reader opened it.
+ */
+void Audio_WAV_CloseReader( WAV_Reader *reader )
+{
+    if( reader->isMapped )
+    {
+#ifdef _WIN32
+        UnmapViewOfFile( reader->image );
+        CloseHandle( (HANDLE) reader->mappingHandle );
+        CloseHandle( (HANDLE) reader->fileHandle );
+#else
+        munmap( (void *) reader->image, reader->imageSize );
+#endif
+    }
+    memset( reader, 0, sizeof(*reader) );
+}
+
+/*********************************************************************************
+ * Pointer to the samples of a frame, in place.
+ */
+const unsigned char *Audio_WAV_FrameData( const WAV_Reader *reader, long long frame )
+{
+    return reader->data + frame * reader->bytesPerFrame;
+}
+
+/*********************************************************************************
+ * Convert up to numFrames frames, starting at frame, to floats in [-1, 1].
+ * Frames are written `stride` floats apart. Channels the file doesn't have
+ * are set to zero, channels beyond the stride are dropped.
+ * Returns number of frames converted.
+ */
+long Audio_WAV_ReadFloats( const WAV_Reader *reader, long long frame, long numFrames,
+        float *samples, int stride )
+{
+    const unsigned char *src;
+    int channels = reader->samplesPerFrame < stride ? reader->samplesPerFrame : stride;
+    long i;
+    int c;
+
+    if( frame < 0 || frame >= reader->numFrames ) return 0;
+    if( numFrames > reader->numFrames - frame ) numFrames = (long) (reader->numFrames - frame);
+
+    /* One loop per sample type, so the inner loops stay branch free. */
+    src = Audio_WAV_FrameData( reader, frame );
+    switch( reader->sampleType )
+    {
+    case WAV_SAMPLE_INT16:
+        for( i=0; i<numFrames; i++ )
+        {
+            const unsigned char *p = src + i * reader->bytesPerFrame;
+            for( c=0; c<channels; c++ )
+            {
+                samples[i*stride + c] = (short) ReadShortLE( p + c*2 ) * (1.0f / 32768.0f);
+            }
+        }
+        break;
+    case WAV_SAMPLE_INT24:
+        for( i=0; i<numFrames; i++ )
+        {
+            const unsigned char *p = src + i * reader->bytesPerFrame;
+            for( c=0; c<channels; c++ )
+            {
+                const unsigned char *s = p + c*3;
+                int v = (int) (((unsigned int) s[0] << 8) | ((unsigned int) s[1] << 16) | ((unsigned int) s[2] << 24)) >> 8;
+                samples[i*stride + c] = v * (1.0f / 8388608.0f);
+            }
+        }
+        break;
+    case WAV_SAMPLE_FLOAT32:
+        /* Assumes a little endian host, like every platform Rack runs on. */
+        for( i=0; i<numFrames; i++ )
+        {
+            memcpy( samples + i*stride, src + i * reader->bytesPerFrame, channels * sizeof(float) );
+        }
+        break;
+    }
+    for( i=0; i<numFrames; i++ )
+    {
+        for( c=channels; c<stride; c++ )
+        {
+            samples[i*stride + c] = 0.0f;
+        }
+    }
+    return numFrames;
+}
+
+/*********************************************************************************
+ * Command line validator: prints the format of each file, then scans every
+ * sample for its peak level and reports the scan throughput.
+ * Build with: cc -O2 -DREAD_WAV_MAIN -Iportaudio -o wavinfo portaudio/read_wav.c
+ */
+#ifdef READ_WAV_MAIN
+#include <time.h>
+
+#define SCAN_FRAMES (4096)
+
+static const char *SampleTypeName( int sampleType )
+{
+    switch( sampleType )
+    {
+    case WAV_SAMPLE_INT16: return "16-bit PCM";
+    case WAV_SAMPLE_INT24: return "24-bit PCM";
+    case WAV_SAMPLE_FLOAT32: return "32-bit float";
+    }
+    return "unknown";
+}
+
+int main( int argc, char **argv )
+{
+    int i;
+    int errors = 0;
+
+    if( argc < 2 )
+    {
+        fprintf( stderr, "Usage: %s file.wav ...\n", argv[0] );
+        return 1;
+    }
+
+    for( i=1; i<argc; i++ )
+    {
+        WAV_Reader reader;
+        long long frame;
+        float *buffer;
+        float peak = 0.0f;
+        clock_t start;
+        double seconds;
+        long result = Audio_WAV_OpenReader( &reader, argv[i] );
+        if( result < 0 )
+        {
+            printf( "%s: ERROR: result = %ld\n", argv[i], result );
+            errors++;
+            continue;
+        }
+
+        printf( "%s: %s, %d channels, %d Hz, %lld frames (%.1f s)%s\n",
+                argv[i], SampleTypeName( reader.sampleType ), reader.samplesPerFrame,
+                reader.frameRate, reader.numFrames, (double) reader.numFrames / reader.frameRate,
+                reader.truncated ? ", truncated" : "" );
+        if( reader.timeReference )
+        {
+            printf( "%s: starts at sample %llu\n", argv[i], reader.timeReference );
+        }
+
+        buffer = (float *) malloc( SCAN_FRAMES * reader.samplesPerFrame * sizeof(float) );
+        start = clock();
+        for( frame=0; frame<reader.numFrames; frame+=SCAN_FRAMES )
+        {
+            long n = Audio_WAV_ReadFloats( &reader, frame, SCAN_FRAMES, buffer, reader.samplesPerFrame );
+            long j;
+            for( j=0; j<n * reader.samplesPerFrame; j++ )
+            {
+                float a = buffer[j] < 0.0f ? -buffer[j] : buffer[j];
+                if( a > peak ) peak = a;
+            }
+        }
+        seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+        printf( "  peak %.4f, scanned %.1f MB in %.3f s\n", peak,
+                reader.numFrames * reader.bytesPerFrame / 1e6, seconds );
+
+        free( buffer );
+        Audio_WAV_CloseReader( &reader );
+    }
+    return errors ? 1 : 0;
+}
+#endif
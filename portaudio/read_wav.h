@@ -0,0 +1,97 @@
+#ifndef _WAV_READER_H
+#define _WAV_READER_H
+
+/*
+ * Zero-copy WAV file reader.
+ *
+ * The file is memory mapped and parsed in place. Sample data is never
+ * copied: the reader points into the mapped image, and callers either use
+ * the samples there or convert the frames they need to float.
+ *
+ * Handles 16-bit and 24-bit PCM, 32-bit float, WAVE_FORMAT_EXTENSIBLE
+ * headers, RF64 files larger than 4GB, and files whose header was never
+ * finalized, such as recordings cut short by a crash.
+ */
+
+#include <stdio.h>
+#include "write_wav.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RF64_ID   (('R'<<24) | ('F'<<16) | ('6'<<8) | '4')
+#define DS64_ID   (('d'<<24) | ('s'<<16) | ('6'<<8) | '4')
+
+#define WAVE_FORMAT_IEEE_FLOAT (0x0003)
+#define WAVE_FORMAT_EXTENSIBLE (0xFFFE)
+
+/* Sample types of the data chunk. */
+#define WAV_SAMPLE_INT16       (1)
+#define WAV_SAMPLE_INT24       (2)
+#define WAV_SAMPLE_FLOAT32     (3)
+
+typedef struct WAV_Reader_s
+{
+    /* The whole file, mapped read-only. */
+    const unsigned char *image;
+    long long imageSize;
+    /* Platform handles, only set if the reader mapped the file itself. */
+    int   isMapped;
+    void *fileHandle;
+    void *mappingHandle;
+
+    int   sampleType; /* WAV_SAMPLE_* */
+    int   samplesPerFrame;
+    int   frameRate;
+    int   bytesPerFrame;
+
+    /* Interleaved little endian sample data, in place. */
+    const unsigned char *data;
+    long long numFrames;
+
+    /* Non-zero if the data chunk is shorter than its header claims, or its
+     * size was never written. numFrames then counts the whole frames present. */
+    int   truncated;
+
+    /* Broadcast Wave TimeReference of the first frame, in samples, or zero. */
+    unsigned long long timeReference;
+} WAV_Reader;
+
+/*********************************************************************************
+ * Parse a WAV file image already in memory. The reader points into the image,
+ * which has to outlive it.
+ * Returns zero or negative error code.
+ */
+long Audio_WAV_ParseImage( WAV_Reader *reader, const unsigned char *image, long long imageSize );
+
+/*********************************************************************************
+ * Map named file into memory and parse it.
+ * Returns zero or negative error code.
+ */
+long Audio_WAV_OpenReader( WAV_Reader *reader, const char *fileName );
+
+/*********************************************************************************
+ * Unmap the file, if the reader opened it.
+ */
+void Audio_WAV_CloseReader( WAV_Reader *reader );
+
+/*********************************************************************************
+ * Pointer to the samples of a frame, in place.
+ */
+const unsigned char *Audio_WAV_FrameData( const WAV_Reader *reader, long long frame );
+
+/*********************************************************************************
+ * Convert up to numFrames frames, starting at frame, to floats in [-1, 1].
+ * Frames are written `stride` floats apart. Channels the file doesn't have
+ * are set to zero, channels beyond the stride are dropped.
+ * Returns number of frames converted.
+ */
+long Audio_WAV_ReadFloats( const WAV_Reader *reader, long long frame, long numFrames,
+        float *samples, int stride );
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _WAV_READER_H */
@@ -41,6 +41,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "write_wav.h"
 
 
@@ -79,21 +81,45 @@ static void WriteChunkType( unsigned char **addrPtr, unsigned long cktyp )
         4 + 4 + 16 + /* fmt chunk */ \
         4 + 4 ) /* data chunk */
 
+/* Broadcast Wave extension, version 1 (EBU Tech 3285). */
+#define BEXT_SIZE (256 + 32 + 32 + 10 + 8 + /* Description, Originator, OriginatorReference, date, time */ \
+        4 + 4 + 2 + 64 + 10 + 180) /* TimeReference, Version, UMID, loudness, reserved */
+#define BEXT_TIME_REFERENCE (256 + 32 + 32 + 10 + 8)
 
-/*********************************************************************************
- * Open named file and write WAV header to the file.
- * The header includes the DATA chunk type and size.
- * Returns number of bytes written to file or negative error code.
- */
-long Audio_WAV_OpenWriter( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame )
+/* Write the bext chunk, with the origination date and time set to now. */
+static void WriteBext( unsigned char **addrPtr, const char *originator )
+{
+	unsigned char *body;
+	time_t now = time( NULL );
+	struct tm *local = localtime( &now );
+
+	WriteChunkType( addrPtr, BEXT_ID );
+	WriteLongLE( addrPtr, BEXT_SIZE );
+	body = *addrPtr;
+	memset( body, 0, BEXT_SIZE );
+	strncpy( (char *) body + 256, originator, 32 );
+	if( local )
+	{
+		char stamp[20];
+		strftime( stamp, sizeof(stamp), "%Y-%m-%d%H:%M:%S", local );
+		memcpy( body + 256 + 32 + 32, stamp, 10 + 8 );
+	}
+	body[BEXT_TIME_REFERENCE + 8] = 1; /* Version */
+	*addrPtr = body + BEXT_SIZE;
+}
+
+static long OpenWriter( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame,
+		const char *originator )
 {
 	unsigned int  bytesPerSecond;
-    unsigned char header[ WAV_HEADER_SIZE ];
+    unsigned char header[ WAV_HEADER_SIZE + 8 + BEXT_SIZE ];
 	unsigned char *addr = header;
     int numWritten;
 	
     writer->dataSize = 0;
     writer->dataSizeOffset = 0;
+    writer->timeReferenceOffset = 0;
+    writer->timeReference = 0;
 	
     writer->fid = fopen( fileName, "wb" );
     if( writer->fid == NULL )
@@ -121,18 +147,46 @@ long Audio_WAV_OpenWriter( WAV_Writer *writer, const char *fileName, int frameRa
 	WriteShortLE( &addr, (short) (samplesPerFrame * sizeof( short)) ); /* bytesPerBlock */
 	WriteShortLE( &addr, (short) 16 ); /* bits per sample */
 
+	if( originator )
+	{
+		writer->timeReferenceOffset = (int) (addr - header) + 8 + BEXT_TIME_REFERENCE;
+		WriteBext( &addr, originator );
+	}
+
 /* Write ID and size for 'data' chunk. */
 	WriteChunkType( &addr, DATA_ID );
 /* Save offset so we can patch it later. */
     writer->dataSizeOffset = (int) (addr - header);
 	WriteLongLE( &addr, 0 );
 
-    numWritten = fwrite( header, 1, sizeof(header), writer->fid );
-    if( numWritten != sizeof(header) ) return -1;
+    writer->headerSize = (int) (addr - header);
+    numWritten = fwrite( header, 1, writer->headerSize, writer->fid );
+    if( numWritten != writer->headerSize ) return -1;
 
 	return (int) numWritten;
 }
 
+/*********************************************************************************
+ * Open named file and write WAV header to the file.
+ * The header includes the DATA chunk type and size.
+ * Returns number of bytes written to file or negative error code.
+ */
+long Audio_WAV_OpenWriter( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame )
+{
+	return OpenWriter( writer, fileName, frameRate, samplesPerFrame, NULL );
+}
+
+long Audio_WAV_OpenBextWriter( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame,
+		const char *originator )
+{
+	return OpenWriter( writer, fileName, frameRate, samplesPerFrame, originator );
+}
+
+void Audio_WAV_SetTimeReference( WAV_Writer *writer, unsigned long long timeReference )
+{
+	writer->timeReference = timeReference;
+}
+
 /*********************************************************************************
  * Write to the data chunk portion of a WAV file.
  * Returns bytes written or negative error code.
@@ -185,11 +239,27 @@ long Audio_WAV_CloseWriter( WAV_Writer *writer )
     numWritten = fwrite( buffer, 1, sizeof( buffer), writer->fid );
     if( numWritten != sizeof(buffer) ) return -1;
 
+    /* Update bext TimeReference, as two long words */
+    if( writer->timeReferenceOffset )
+    {
+        result = fseek( writer->fid, writer->timeReferenceOffset, SEEK_SET );
+        if( result < 0 ) return result;
+
+        bufferPtr = buffer;
+        WriteLongLE( &bufferPtr, (unsigned long) (writer->timeReference & 0xFFFFFFFF) );
+        numWritten = fwrite( buffer, 1, sizeof( buffer), writer->fid );
+        if( numWritten != sizeof(buffer) ) return -1;
+        bufferPtr = buffer;
+        WriteLongLE( &bufferPtr, (unsigned long) (writer->timeReference >> 32) );
+        numWritten = fwrite( buffer, 1, sizeof( buffer), writer->fid );
+        if( numWritten != sizeof(buffer) ) return -1;
+    }
+
     /* Update RIFF size */
     result = fseek( writer->fid, 4, SEEK_SET );
     if( result < 0 ) return result;
 
-    riffSize = writer->dataSize + (WAV_HEADER_SIZE - 8);
+    riffSize = writer->dataSize + (writer->headerSize - 8);
     bufferPtr = buffer;
     WriteLongLE( &bufferPtr, riffSize );
     numWritten = fwrite( buffer, 1, sizeof( buffer), writer->fid );
@@ -53,6 +53,7 @@ extern "C" {
 #define FMT_ID    (('f'<<24) | ('m'<<16) | ('t'<<8) | ' ')
 #define DATA_ID   (('d'<<24) | ('a'<<16) | ('t'<<8) | 'a')
 #define FACT_ID   (('f'<<24) | ('a'<<16) | ('c'<<8) | 't')
+#define BEXT_ID   (('b'<<24) | ('e'<<16) | ('x'<<8) | 't')
 
 /* Errors returned by Audio_ParseSampleImage_WAV */
 #define WAV_ERR_CHUNK_SIZE     (-1)   /* Chunk size is illegal or past file size. */
@@ -72,6 +73,11 @@ typedef struct WAV_Writer_s
     /* Offset in file for data size. */
     int   dataSizeOffset;
     int   dataSize;
+    /* Size of everything before the sample data. */
+    int   headerSize;
+    /* Offset in file of the bext TimeReference, or zero without a bext chunk. */
+    int   timeReferenceOffset;
+    unsigned long long timeReference;
 } WAV_Writer;
 
 /*********************************************************************************
@@ -81,6 +87,20 @@ typedef struct WAV_Writer_s
  */
 long Audio_WAV_OpenWriter( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame );
 
+/*********************************************************************************
+ * Like Audio_WAV_OpenWriter, with a Broadcast Wave (bext) chunk ahead of the
+ * data. Its TimeReference, the position of the first frame in samples, is
+ * written on close; set it with Audio_WAV_SetTimeReference.
+ * Returns number of bytes written to file or negative error code.
+ */
+long Audio_WAV_OpenBextWriter( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame,
+		const char *originator );
+
+/*********************************************************************************
+ * Set the bext TimeReference, in samples. Written when the file is closed.
+ */
+void Audio_WAV_SetTimeReference( WAV_Writer *writer, unsigned long long timeReference );
+
 /*********************************************************************************
  * Write to the data chunk portion of a WAV file.
  * Returns bytes written or negative error code.
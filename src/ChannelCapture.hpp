@@ -0,0 +1,87 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+
+
+// How the Recorder captures one input. Audio goes into the main file at the
+// engine rate. CV is low-pass filtered and decimated into a sidecar WAV file,
+// and gates are logged only when they change, into a sidecar CSV file.
+enum CaptureMode {
+	CAPTURE_AUDIO,
+	CAPTURE_CV,
+	CAPTURE_GATE,
+	NUM_CAPTURE_MODES
+};
+
+const int CV_DECIMATION = 32;
+
+inline const char *captureModeName(int mode) {
+	static const char *names[NUM_CAPTURE_MODES] = {"Audio", "CV (1/32 rate)", "Gate (changes only)"};
+	return names[mode];
+}
+
+// Second-order low-pass section, in transposed direct form II.
+struct Biquad {
+	float b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+	float z1 = 0.0, z2 = 0.0;
+
+	void setLowpass(float cutoff, float q) {
+		float w = 2.0 * M_PI * cutoff;
+		float alpha = sinf(w) / (2.0 * q);
+		float c = cosf(w);
+		float a0 = 1.0 + alpha;
+		b0 = (1.0 - c) / 2.0 / a0;
+		b1 = (1.0 - c) / a0;
+		b2 = b0;
+		a1 = -2.0 * c / a0;
+		a2 = (1.0 - alpha) / a0;
+		z1 = z2 = 0.0;
+	}
+
+	float process(float in) {
+		float out = b0 * in + z1;
+		z1 = b1 * in - a1 * out + z2;
+		z2 = b2 * in - a2 * out;
+		return out;
+	}
+};
+
+// Decimates by CV_DECIMATION behind a 4th-order Butterworth anti-alias
+// filter, at 80% of the output Nyquist frequency.
+struct CvDecimator {
+	Biquad stages[2];
+	int phase = 0;
+
+	CvDecimator() {
+		float cutoff = 0.4 / CV_DECIMATION; // relative to the input rate
+		stages[0].setLowpass(cutoff, 0.5412);
+		stages[1].setLowpass(cutoff, 1.3066);
+	}
+
+	// Returns true when `out` holds the next output sample.
+	bool process(float in, float *out) {
+		float y = stages[1].process(stages[0].process(in));
+		if (++phase < CV_DECIMATION) {
+			return false;
+		}
+		phase = 0;
+		*out = y;
+		return true;
+	}
+};
+
+// Gate state with hysteresis, so noise around the threshold doesn't log a
+// burst of changes.
+struct GateChanges {
+	bool high = false;
+
+	// Returns true when the state changed.
+	bool process(float volts) {
+		bool next = high ? (volts > 0.5) : (volts >= 1.0);
+		if (next == high) {
+			return false;
+		}
+		high = next;
+		return true;
+	}
+};
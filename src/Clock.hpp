@@ -0,0 +1,63 @@
+#pragma once
+#include <limits.h>
+#include <math.h>
+
+
+// Internal sequencer clock.
+// Ticks whenever the phase, advanced by 2^voct * multiplier / sampleRate per
+// sample, crosses 1. The exp2 result is cached until the pitch moves by more
+// than `epsilon` octaves, and rather than accumulating the phase on every
+// sample we schedule the number of samples until the next tick. Between
+// ticks process() only compares its inputs and decrements a counter.
+struct InternalClock {
+	static constexpr float epsilon = 1e-6;
+
+	float voct = INFINITY;
+	float multiplier = 0.0;
+	float sampleRate = 0.0;
+	double delta = 0.0; // phase increment per sample
+	double phase = 0.0; // at the start of the current schedule
+	int period = 0; // length of the current schedule, in samples
+	int remaining = 0; // samples until the next tick
+
+	// Returns true on the sample the clock ticks.
+	bool process(float voct, float multiplier, float sampleRate) {
+		if (fabsf(voct - this->voct) > epsilon || multiplier != this->multiplier || sampleRate != this->sampleRate) {
+			// Fold the samples elapsed at the old rate into the phase, then reschedule
+			phase += (period - remaining) * delta;
+			this->voct = voct;
+			this->multiplier = multiplier;
+			this->sampleRate = sampleRate;
+			// In double: a float increment drifts by samples over a few minutes
+			delta = exp2((double) voct) * multiplier / sampleRate;
+			schedule();
+		}
+		if (--remaining > 0) {
+			return false;
+		}
+		phase += period * delta - 1.0;
+		schedule();
+		return true;
+	}
+
+	void reset() {
+		phase = 0.0;
+		if (delta > 0.0) {
+			schedule();
+		} else {
+			period = remaining = 0;
+		}
+	}
+
+	void schedule() {
+		double samples = ceil((1.0 - phase) / delta);
+		if (samples < 1.0) {
+			period = 1;
+		} else if (samples > INT_MAX / 2) {
+			period = INT_MAX / 2;
+		} else {
+			period = (int) samples;
+		}
+		remaining = period;
+	}
+};
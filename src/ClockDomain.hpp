@@ -0,0 +1,138 @@
+#pragma once
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+
+
+// Plugin-wide clock shared by synced sequencers.
+// The first subscriber to step becomes the lead, and its clock rate drives
+// the domain. The phase is a function of the engine frame, so every
+// subscriber sees the same phase on a frame whether the engine steps it
+// before or after the lead. It is an integer in 32.32 fixed point (one beat
+// is 1 << 32), so all subscribers derive their steps from the same integer
+// and rational ratios of it never drift apart.
+struct ClockDomain {
+	static constexpr float epsilon = 1e-6;
+
+	std::atomic<void*> lead;
+	// The phase at baseFrame, from which it grows by increment per frame
+	uint64_t basePhase = 0;
+	uint64_t baseFrame = 0;
+	uint64_t increment = 0;
+	uint64_t leadFrame = 0; // the last frame the lead advanced
+	float voct = INFINITY;
+	float sampleRate = 0.0;
+
+	// The latest engine frame, as published by every FrameFollower
+	std::atomic<uint64_t> frame;
+
+	ClockDomain() : lead(NULL), frame(0) {}
+
+	// Called by every subscriber once per sample, with the engine frame.
+	// Returns true for the lead.
+	bool advance(void *owner, uint64_t frame) {
+		void *current = lead.load(std::memory_order_relaxed);
+		if (current != owner) {
+			if (current || !lead.compare_exchange_strong(current, owner)) {
+				return false;
+			}
+			// Carry on from the last frame any lead ran, rather than jump by
+			// the frames counted while none did
+			basePhase = phaseAt(leadFrame);
+			baseFrame = frame - 1;
+		}
+		leadFrame = frame;
+		return true;
+	}
+
+	uint64_t phaseAt(uint64_t frame) const {
+		return basePhase + (frame - baseFrame) * increment;
+	}
+
+	// Lets another subscriber take over, e.g. when the lead is deleted.
+	void release(void *owner) {
+		void *expected = owner;
+		lead.compare_exchange_strong(expected, NULL);
+	}
+
+	// Sets the base clock rate from the lead's clock pitch, from the frame
+	// after `frame` on. The phase at `frame` itself is unchanged, so it
+	// matches what subscribers stepped earlier on that frame saw.
+	void setRate(float voct, float sampleRate, uint64_t frame) {
+		if (fabsf(voct - this->voct) > epsilon || sampleRate != this->sampleRate) {
+			basePhase = phaseAt(frame);
+			baseFrame = frame;
+			this->voct = voct;
+			this->sampleRate = sampleRate;
+			increment = (uint64_t) llround(exp2((double) voct) / sampleRate * 4294967296.0);
+		}
+	}
+};
+
+extern ClockDomain gClockDomain;
+
+
+// The engine frame of the current sample, the same for every subscriber
+// whatever order the engine steps them in. Nothing a module sees within a
+// sample tells it whether it steps before or after another, so each counts
+// its own samples and only takes the shared count on its first sample.
+// Rack appends new modules to its step order, so by then every older
+// subscriber has published the current frame.
+struct FrameFollower {
+	uint64_t now = 0;
+	bool started = false;
+
+	// Engine thread, once per sample
+	uint64_t process() {
+		now = started ? now + 1 : gClockDomain.frame.load(std::memory_order_relaxed);
+		started = true;
+		gClockDomain.frame.store(now, std::memory_order_relaxed);
+		return now;
+	}
+};
+
+
+// Derives steps at an exact ratio num/den of the domain's base clock.
+// Step s is due once the domain phase reaches s * den / num beats, rounded up
+// to the next phase unit, so per sample this is a single wrap-safe compare
+// against the next threshold.
+struct DomainClock {
+	int num = 0;
+	int den = 0;
+	uint64_t count = 0; // steps taken
+	uint64_t next = 0; // phase threshold of the next step
+
+	// Returns true on the sample the next step is due.
+	bool process(uint64_t phase, int num, int den) {
+		if (num != this->num || den != this->den) {
+			sync(phase, num, den);
+		}
+		if ((int64_t) (phase - next) < 0) {
+			return false;
+		}
+		count++;
+		next = threshold(count + 1);
+		return true;
+	}
+
+	// Forces a resync on the next call to process().
+	void reset() {
+		num = den = 0;
+	}
+
+	// Aligns the step count to the current domain phase without stepping.
+	void sync(uint64_t phase, int num, int den) {
+		this->num = num;
+		this->den = den;
+		uint64_t beats = (uint64_t) den << 32;
+		count = (phase / beats) * num + ((phase % beats) * num) / beats;
+		next = threshold(count + 1);
+	}
+
+	uint64_t threshold(uint64_t step) const {
+		uint64_t beats = (uint64_t) den << 32;
+		uint64_t q = step / num;
+		uint64_t r = step % num;
+		return q * beats + (r * beats + num - 1) / num;
+	}
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Euclidean rhythms as step masks, for up to EUCLID_MAX_STEPS steps.
+// Step i of k hits in n steps is set if (i * k) mod n < k, which spreads the
+// hits as evenly as Bjorklund's algorithm and starts on a hit. All masks are
+// computed at compile time, so a lookup is a load plus a rotate, with no
+// loops or allocation on the audio thread.
+
+const int EUCLID_MAX_STEPS = 32;
+
+constexpr uint32_t euclidStepMask(int n) {
+	return (n >= 32) ? 0xFFFFFFFFu : ((1u << n) - 1);
+}
+
+constexpr uint32_t euclidBits(int n, int k, int i) {
+	return (i >= n) ? 0 : (((i * k) % n < k ? 1u : 0u) << i) | euclidBits(n, k, i + 1);
+}
+
+// C++11 has no std::index_sequence; this one halves N on each level, so the
+// template depth stays logarithmic.
+template <size_t... I>
+struct EuclidIndices {};
+
+template <class A, class B>
+struct EuclidConcat;
+
+template <size_t... A, size_t... B>
+struct EuclidConcat<EuclidIndices<A...>, EuclidIndices<B...>> {
+	typedef EuclidIndices<A..., (sizeof...(A) + B)...> type;
+};
+
+template <size_t N>
+struct EuclidRange {
+	typedef typename EuclidConcat<typename EuclidRange<N / 2>::type, typename EuclidRange<N - N / 2>::type>::type type;
+};
+
+template <>
+struct EuclidRange<0> {
+	typedef EuclidIndices<> type;
+};
+
+template <>
+struct EuclidRange<1> {
+	typedef EuclidIndices<0> type;
+};
+
+// One entry per step count 1..EUCLID_MAX_STEPS and hit count 0..EUCLID_MAX_STEPS,
+// with hits above the step count clamped.
+struct EuclidTable {
+	static const int HITS = EUCLID_MAX_STEPS + 1;
+	static const int SIZE = EUCLID_MAX_STEPS * HITS;
+	uint32_t masks[SIZE];
+};
+
+constexpr uint32_t euclidEntry(int n, int k) {
+	return euclidBits(n, k > n ? n : k, 0);
+}
+
+template <size_t... I>
+constexpr EuclidTable makeEuclidTable(EuclidIndices<I...>) {
+	return EuclidTable {{euclidEntry(I / EuclidTable::HITS + 1, I % EuclidTable::HITS)...}};
+}
+
+static constexpr EuclidTable euclidTable = makeEuclidTable(EuclidRange<EuclidTable::SIZE>::type());
+
+static_assert(euclidTable.masks[(8 - 1) * EuclidTable::HITS + 3] == 0x49, "E(3, 8) is x..x..x.");
+static_assert(euclidTable.masks[(16 - 1) * EuclidTable::HITS + 16] == 0xFFFF, "all hits");
+
+// The mask of `hits` in `steps`, rotated by `rotation` steps towards the end.
+// Expects 1 <= steps <= EUCLID_MAX_STEPS, 0 <= hits and 0 <= rotation < steps.
+inline uint32_t euclid(int steps, int hits, int rotation) {
+	uint32_t mask = euclidTable.masks[(steps - 1) * EuclidTable::HITS + (hits < EuclidTable::HITS ? hits : EuclidTable::HITS - 1)];
+	if (rotation == 0) {
+		return mask;
+	}
+	return ((mask << rotation) | (mask >> (steps - rotation))) & euclidStepMask(steps);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+#include "rack.hpp"
+
+using namespace rack;
+
+
+// Counts how many samples a module's step() finished on its idle fast path.
+// Only the engine thread writes the counters. The UI reads them for display,
+// and may occasionally see a stale value.
+struct FastPathStats {
+	uint64_t samples = 0;
+	uint64_t idleSamples = 0;
+
+	float idleFraction() const {
+		return samples ? (float) idleSamples / samples : 0.0;
+	}
+	std::string label() const {
+		return stringf("Idle fast path: %.1f%%", 100.0 * idleFraction());
+	}
+};
+
+// An LEDButton that raises its module's `edited` flag whenever it changes,
+// so the module only has to poll its buttons after an edit.
+template <class TModule>
+struct EditButton : LEDButton {
+	void onChange(EventChange &e) override {
+		LEDButton::onChange(e);
+		if (module) {
+			static_cast<TModule*>(module)->edited.store(true, std::memory_order_relaxed);
+		}
+	}
+};
@@ -1,66 +1,268 @@
+#include <atomic>
+#include <thread>
+#include <string.h>
+
 #include "dekstop.hpp"
 #include "dsp/digital.hpp"
+#include "Clock.hpp"
+#include "ClockDomain.hpp"
+#include "Euclid.hpp"
+#include "FastPath.hpp"
+#include "LightDecay.hpp"
+#include "PatternCodec.hpp"
+#include "Random.hpp"
+#include "StepSettings.hpp"
+#include "Trace.hpp"
+
+const int NUM_PATTERNS = 64;
+
+// One pattern: a bitmask of active steps per channel, and per-step settings.
+template <int Steps, int Channels>
+struct Pattern {
+	uint32_t rows[Channels];
+	StepSettings steps[Steps];
+
+	bool get(int channel, int step) const {
+		return (rows[channel] >> step) & 1;
+	}
+	void set(int channel, int step, bool gate) {
+		rows[channel] = (rows[channel] & ~(1u << step)) | ((uint32_t) gate << step);
+	}
+	void toggle(int channel, int step) {
+		rows[channel] ^= 1u << step;
+	}
+	bool empty() const {
+		for (int y = 0; y < Channels; y++) {
+			if (rows[y]) return false;
+		}
+		for (int x = 0; x < Steps; x++) {
+			if (!steps[x].isDefault()) return false;
+		}
+		return true;
+	}
+};
+
+// Preallocated bank of patterns.
+// Only the engine thread writes `patterns`, and only with `stagingLock`
+// held, so the UI thread reads a slot with read() under the lock. Edits from
+// the UI thread go to `staging` under the lock and mark their slot as
+// pending. The engine copies pending slots across at the start of a step,
+// but only try-locks, so it never blocks or allocates.
+template <int Steps, int Channels>
+struct PatternBank {
+	Pattern<Steps, Channels> patterns[NUM_PATTERNS] = {};
+	Pattern<Steps, Channels> staging[NUM_PATTERNS] = {};
+	std::atomic<uint64_t> pendingSlots;
+	std::atomic_flag stagingLock = ATOMIC_FLAG_INIT;
+
+	PatternBank() : pendingSlots(0) {}
+
+	// Engine thread. Returns true if any slot changed.
+	bool apply() {
+		uint64_t pending = pendingSlots.load(std::memory_order_relaxed);
+		if (!pending || stagingLock.test_and_set(std::memory_order_acquire)) {
+			return false;
+		}
+		pending = pendingSlots.load(std::memory_order_relaxed);
+		for (int i = 0; i < NUM_PATTERNS; i++) {
+			if (pending & (1ull << i)) {
+				patterns[i] = staging[i];
+			}
+		}
+		pendingSlots.store(0, std::memory_order_relaxed);
+		stagingLock.clear(std::memory_order_release);
+		return true;
+	}
+	// Engine thread, for other writes to `patterns`. Release with unlock().
+	bool tryLock() {
+		return !stagingLock.test_and_set(std::memory_order_acquire);
+	}
+
+	// UI thread
+	void lock() {
+		while (stagingLock.test_and_set(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+	}
+	void unlock() {
+		stagingLock.clear(std::memory_order_release);
+	}
+	// Latest state of a slot, including edits the engine has not applied yet.
+	// Call with the lock held.
+	const Pattern<Steps, Channels> &read(int slot) const {
+		bool pending = pendingSlots.load(std::memory_order_relaxed) & (1ull << slot);
+		return pending ? staging[slot] : patterns[slot];
+	}
+	// Call with the lock held.
+	void write(int slot, const Pattern<Steps, Channels> &pattern) {
+		staging[slot] = pattern;
+		pendingSlots.fetch_or(1ull << slot, std::memory_order_relaxed);
+	}
+};
+
+struct ClockMultiplier {
+	int num;
+	int den;
+	float value;
+	const char *label;
+};
 
-const int NUM_STEPS = 12;
-const int NUM_CHANNELS = 8;
-const int NUM_GATES = NUM_STEPS * NUM_CHANNELS;
+static const ClockMultiplier clockMultipliers[] = {
+	{1, 4, 0.25, "1/4"}, {1, 3, 1.0/3.0, "1/3"}, {1, 2, 0.5, "1/2"}, {3, 4, 0.75, "3/4"},
+	{1, 1, 1.0, "1/1"}, {3, 2, 1.5, "3/2"}, {2, 1, 2.0, "2/1"}, {3, 1, 3.0, "3/1"},
+	{4, 1, 4.0, "4/1"}, {6, 1, 6.0, "6/1"}, {8, 1, 8.0, "8/1"}, {12, 1, 12.0, "12/1"}
+};
+const int NUM_CLOCK_MULTIPLIERS = sizeof(clockMultipliers) / sizeof(clockMultipliers[0]);
+const int DEFAULT_CLOCK_MULTIPLIER = 4;
+
+// Nearest table entry, so that older patches which stored 0.3 for "1/3" lock.
+static int findClockMultiplier(float value) {
+	int nearest = DEFAULT_CLOCK_MULTIPLIER;
+	for (int i = 0; i < NUM_CLOCK_MULTIPLIERS; i++) {
+		if (fabsf(clockMultipliers[i].value - value) < fabsf(clockMultipliers[nearest].value - value)) {
+			nearest = i;
+		}
+	}
+	return nearest;
+}
+
+// Adjacent GateSEQs of the same size form a chain: the leftmost one runs the
+// clock for all of them, and steps the others from its own step() in the same
+// sample, so there is no cable latency between them.
+enum ChainMode {
+	CHAIN_ROWS, // all modules play in parallel, as one taller grid
+	CHAIN_STEPS, // the modules play one after another, as one longer pattern
+	NUM_CHAIN_MODES
+};
+
+// Gate sequencer with a compile-time grid of Steps x Channels. Storage and
+// loop bounds are constant per model, so the compiler unrolls and vectorizes
+// the per-sample loops for each size.
+template <int Steps, int Channels>
+struct GateSEQ : Module {
+	static_assert(Steps <= 32, "a pattern row is a 32-bit step mask");
 
-struct GateSEQ8 : Module {
-	
 	enum ParamIds {
 		CLOCK_PARAM,
 		RUN_PARAM,
 		RESET_PARAM,
 		STEPS_PARAM,
-		GATE1_PARAM,
-		NUM_PARAMS = GATE1_PARAM + NUM_GATES
+		PATTERN_PARAM,
+		HITS1_PARAM, // Euclidean hits per row, 0 for a row edited by hand
+		NUM_PARAMS = HITS1_PARAM + Channels
 	};
 	enum InputIds {
 		CLOCK_INPUT,
 		EXT_CLOCK_INPUT,
 		RESET_INPUT,
 		STEPS_INPUT,
+		PATTERN_INPUT,
+		HITS_INPUT,
+		ROTATE_INPUT,
 		NUM_INPUTS
 	};
 	enum OutputIds {
 		GATE1_OUTPUT,
-		NUM_OUTPUTS = GATE1_OUTPUT + NUM_CHANNELS
+		NUM_OUTPUTS = GATE1_OUTPUT + Channels
 	};
 	enum LightIds {
 		RUNNING_LIGHT,
 		RESET_LIGHT,
-		GATE_LIGHTS,
-		NUM_LIGHTS = GATE_LIGHTS + NUM_GATES
+		NUM_LIGHTS
 	};
 
 	bool running = true;
 	SchmittTrigger clockTrigger; // for external clock
 	SchmittTrigger runningTrigger;
 	SchmittTrigger resetTrigger;
-	float multiplier = 1.0;
-	float phase = 0.0;
+	int multiplier = DEFAULT_CLOCK_MULTIPLIER; // index into clockMultipliers
+	bool synced = false; // follow the shared clock domain
+	DomainClock domainClock;
+	FrameFollower frames; // ticked on every sample, synced or not
+	InternalClock clock;
 	int index = 0;
-	SchmittTrigger gateTriggers[NUM_GATES];
-	bool gateState[NUM_GATES] = {};
-	float stepLights[NUM_GATES] = {};
-
-	GateSEQ8() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS) {}
+	int pattern = 0;
+	PatternBank<Steps, Channels> bank;
+	Random random;
+	Ratchet ratchet;
+	uint32_t skipped = 0; // channels whose gate was skipped this step
+	int stepLength = 0; // in samples, as last measured
+	int stepCounter = 0;
+	int activeSamples = 0; // until the step lights have faded
+	FastPathStats stats;
+	std::atomic<uint32_t> revision; // bumped when the pattern or playhead changes
+	float stepLights[Steps] = {};
+	// Generator params and inputs as of the last generateRows() that ran,
+	// in the order it reads them, and the pattern it wrote
+	float generatorInputs[Channels + 4] = {};
+	int generatedPattern = -1;
+	LightDecay lightDecay = LightDecay(0.1);
+
+	// Chain links. They are only changed by the UI thread, which unlinks a
+	// module before it is removed from the engine.
+	int chainMode = CHAIN_ROWS; // set on the leftmost module
+	std::atomic<GateSEQ*> chainNext; // the module on our right, which we step
+	std::atomic_bool chained; // stepped by the module on our left
+	uint64_t chainFrame = UINT64_MAX; // the frame it last stepped us on
+	GateSEQ *chainPrev = NULL; // UI thread only
+	int chainIndex = 0; // position in the whole chain, in steps mode
+	bool muted = false; // the current step belongs to another module in the chain
+
+	GateSEQ() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS), revision(0), chainNext(NULL), chained(false) {
+		random.setSeed(randomu32());
+	}
+	~GateSEQ() {
+		gClockDomain.release(this);
+	}
 	void step();
+	void play(bool nextStep, bool reset, bool active, int selected, int jump);
+	bool generateRows(bool force);
+
+	int numSteps() {
+		return clampi(roundf(params[STEPS_PARAM].value + inputs[STEPS_INPUT].value), 1, Steps);
+	}
+
+	int selectPattern() {
+		return clampi(roundf(params[PATTERN_PARAM].value + inputs[PATTERN_INPUT].value * NUM_PATTERNS / 10.0), 0, NUM_PATTERNS - 1);
+	}
 
 	json_t *toJson() {
 		json_t *rootJ = json_object();
 
 		// Clock multiplier
-		json_t *multiplierJ = json_real(multiplier);
+		json_t *multiplierJ = json_real(clockMultipliers[multiplier].value);
 		json_object_set_new(rootJ, "multiplier", multiplierJ);
 
-		// Gate values
-		json_t *gatesJ = json_array();
-		for (int i = 0; i < NUM_GATES; i++) {
-			json_t *gateJ = json_integer((int) gateState[i]);
-			json_array_append_new(gatesJ, gateJ);
+		// Clock sync
+		json_object_set_new(rootJ, "sync", json_boolean(synced));
+
+		// Chain
+		json_object_set_new(rootJ, "chainMode", json_integer(chainMode));
+
+		// Random seed
+		json_object_set_new(rootJ, "seed", json_integer((json_int_t) random.seed));
+
+		// Patterns, as packed step masks per channel followed by the step
+		// settings, up to the last non-empty one
+		BitWriter writer;
+		bank.lock();
+		int numPatterns = NUM_PATTERNS;
+		while (numPatterns > 1 && bank.read(numPatterns - 1).empty()) {
+			numPatterns--;
 		}
-		json_object_set_new(rootJ, "gates", gatesJ);
+		for (int i = 0; i < numPatterns; i++) {
+			const Pattern<Steps, Channels> &p = bank.read(i);
+			for (int y = 0; y < Channels; y++) {
+				writer.write(p.rows[y], Steps);
+			}
+			for (int x = 0; x < Steps; x++) {
+				writer.write(p.steps[x].skip, 8);
+				writer.write(p.steps[x].ratchets, 2);
+			}
+		}
+		bank.unlock();
+		json_object_set_new(rootJ, "patternFormat", json_integer(PATTERN_FORMAT_VERSION));
+		json_object_set_new(rootJ, "patternData", json_string(writer.finish().c_str()));
 
 		return rootJ;
 	}
@@ -69,148 +271,507 @@ struct GateSEQ8 : Module {
 		// Clock multiplier
 		json_t *multiplierJ = json_object_get(rootJ, "multiplier");
 		if (!multiplierJ) {
-			multiplier = 1.0;
+			multiplier = DEFAULT_CLOCK_MULTIPLIER;
 		} else {
-			multiplier = (float)json_real_value(multiplierJ);
+			multiplier = findClockMultiplier((float)json_real_value(multiplierJ));
+		}
+
+		// Clock sync
+		json_t *syncJ = json_object_get(rootJ, "sync");
+		synced = syncJ && json_is_true(syncJ);
+
+		// Chain
+		json_t *chainModeJ = json_object_get(rootJ, "chainMode");
+		chainMode = chainModeJ ? clampi(json_integer_value(chainModeJ), 0, NUM_CHAIN_MODES - 1) : CHAIN_ROWS;
+
+		// Random seed
+		json_t *seedJ = json_object_get(rootJ, "seed");
+		if (seedJ) {
+			random.setSeed((uint64_t) json_integer_value(seedJ));
 		}
 
-		// Gate values
-		json_t *gatesJ = json_object_get(rootJ, "gates");
-		for (int i = 0; i < NUM_GATES; i++) {
-			json_t *gateJ = json_array_get(gatesJ, i);
-			gateState[i] = !!json_integer_value(gateJ);
+		// Patterns
+		Pattern<Steps, Channels> patterns[NUM_PATTERNS] = {};
+		json_t *formatJ = json_object_get(rootJ, "patternFormat");
+		json_t *dataJ = json_object_get(rootJ, "patternData");
+		if (formatJ && dataJ) {
+			int format = json_integer_value(formatJ);
+			BitReader reader(json_string_value(dataJ));
+			for (int i = 0; i < NUM_PATTERNS && format <= PATTERN_FORMAT_VERSION; i++) {
+				for (int y = 0; y < Channels; y++) {
+					reader.read(&patterns[i].rows[y], Steps);
+				}
+				// Step settings were added in format 2
+				for (int x = 0; x < Steps && format >= 2; x++) {
+					uint32_t skip = 0, ratchets = 0;
+					reader.read(&skip, 8);
+					reader.read(&ratchets, 2);
+					patterns[i].steps[x].skip = skip;
+					patterns[i].steps[x].ratchets = ratchets;
+				}
+			}
+		}
+		else {
+			// Single pattern of gate values, from older versions
+			json_t *gatesJ = json_object_get(rootJ, "gates");
+			for (int i = 0; i < Steps * Channels; i++) {
+				json_t *gateJ = json_array_get(gatesJ, i);
+				patterns[0].set(i / Steps, i % Steps, !!json_integer_value(gateJ));
+			}
+		}
+		bank.lock();
+		for (int i = 0; i < NUM_PATTERNS; i++) {
+			bank.write(i, patterns[i]);
 		}
+		bank.unlock();
 	}
 
 	void reset() {
-		for (int i = 0; i < NUM_GATES; i++) {
-			gateState[i] = false;
+		bank.lock();
+		for (int i = 0; i < NUM_PATTERNS; i++) {
+			bank.write(i, Pattern<Steps, Channels>());
 		}
+		bank.unlock();
 	}
 
+	// New gates for the current pattern. Its step settings are kept, as
+	// TriSEQ3 keeps them.
 	void randomize() {
-		for (int i = 0; i < NUM_GATES; i++) {
-			gateState[i] = (randomf() > 0.5);
+		uint32_t rows[Channels] = {};
+		for (int y = 0; y < Channels; y++) {
+			for (int x = 0; x < Steps; x++) {
+				rows[y] |= (uint32_t) (randomf() > 0.5) << x;
+			}
+		}
+		bank.lock();
+		Pattern<Steps, Channels> p = bank.read(pattern);
+		for (int y = 0; y < Channels; y++) {
+			p.rows[y] = rows[y];
 		}
+		bank.write(pattern, p);
+		bank.unlock();
 	}
 };
 
 
-void GateSEQ8::step() {
+template <int Steps, int Channels>
+void GateSEQ<Steps, Channels>::step() {
+	// Count frames on every sample, so the count is right as soon as we sync
+	uint64_t frame = frames.process();
+	// The frame check covers an unlink between the module on our left
+	// stepping us and our own step() in the same sample
+	if (chained.load(std::memory_order_relaxed) || chainFrame == frame) {
+		// The module on our left steps us
+		if (gClockDomain.lead.load(std::memory_order_relaxed) == this) {
+			gClockDomain.release(this);
+		}
+		return;
+	}
+	TRACE_SAMPLED_SCOPE("GateSEQ::step", 256);
 	#ifdef v_050_dev
 	float gSampleRate = engineGetSampleRate();
 	#endif
-	const float lightLambda = 0.1;
+	bool active = false;
+
 	// Run
 	if (runningTrigger.process(params[RUN_PARAM].value)) {
 		running = !running;
+		active = true;
 	}
-	lights[RUNNING_LIGHT].value = running ? 1.0 : 0.0;
 
 	bool nextStep = false;
+	const ClockMultiplier &m = clockMultipliers[multiplier];
+
+	// Shared clock
+	bool domainStep = false;
+	if (synced) {
+		if (gClockDomain.advance(this, frame)) {
+			gClockDomain.setRate(params[CLOCK_PARAM].value + inputs[CLOCK_INPUT].value, gSampleRate, frame);
+		}
+		// Keep following the domain while stopped, so we stay locked on resume
+		domainStep = domainClock.process(gClockDomain.phaseAt(frame), m.num, m.den);
+	}
+	else {
+		domainClock.reset();
+		if (gClockDomain.lead.load(std::memory_order_relaxed) == this) {
+			gClockDomain.release(this);
+		}
+	}
 
 	if (running) {
 		if (inputs[EXT_CLOCK_INPUT].active) {
 			// External clock
 			if (clockTrigger.process(inputs[EXT_CLOCK_INPUT].value)) {
-				phase = 0.0;
+				clock.reset();
 				nextStep = true;
 			}
 		}
+		else if (synced) {
+			nextStep = domainStep;
+		}
 		else {
 			// Internal clock
-			float clockTime = powf(2.0, params[CLOCK_PARAM].value + inputs[CLOCK_INPUT].value);
-			clockTime = clockTime * multiplier;
-			phase += clockTime / gSampleRate;
-			if (phase >= 1.0) {
-				phase -= 1.0;
+			if (clock.process(params[CLOCK_PARAM].value + inputs[CLOCK_INPUT].value, m.value, gSampleRate)) {
 				nextStep = true;
 			}
 		}
 	}
 
 	// Reset
+	bool reset = false;
 	if (resetTrigger.process(params[RESET_PARAM].value + inputs[RESET_INPUT].value)) {
-		phase = 0.0;
-		index = 999;
+		clock.reset();
+		reset = true;
 		nextStep = true;
+	}
+
+	// Switch patterns on step boundaries only, unless stopped
+	int selected = (nextStep || !running) ? selectPattern() : -1;
+
+	GateSEQ *next = chainNext.load(std::memory_order_acquire);
+	if (!next) {
+		play(nextStep, reset, active, selected, -1);
+		return;
+	}
+
+	// Chained: in steps mode, find the module that owns the next step of the
+	// whole chain, and jump it there
+	int total = 0;
+	if (chainMode == CHAIN_STEPS && nextStep) {
+		for (GateSEQ *member = this; member; member = member->chainNext.load(std::memory_order_acquire)) {
+			total += member->numSteps();
+		}
+		chainIndex = reset ? 0 : chainIndex + 1;
+		if (chainIndex >= total) {
+			chainIndex = 0;
+		}
+	}
+	int offset = 0;
+	for (GateSEQ *member = this; member; member = member->chainNext.load(std::memory_order_acquire)) {
+		int jump = -1;
+		if (chainMode == CHAIN_STEPS && nextStep) {
+			int n = member->numSteps();
+			jump = (chainIndex >= offset && chainIndex < offset + n) ? chainIndex - offset : Steps;
+			offset += n;
+		}
+		member->chainFrame = frame;
+		bool changed = active;
+		if (member->running != running) {
+			member->running = running;
+			changed = true;
+		}
+		member->play(nextStep, reset, changed, selected, jump);
+	}
+}
+
+// Writes Euclidean rows into the current pattern, with their hits offset by
+// 1V per hit at the Hits input, and rotated by 1V per step at the Rotate
+// input. Checked every sample, so the CV is followed at audio rate, but the
+// rows are only worked out again when a generator param or input moves, the
+// pattern changes, or `force` is set after the bank was edited. Rows are
+// only written when a mask changes, and then under the bank's lock; while
+// the UI holds it, they're tried again on the next sample. Returns true if
+// any row changed.
+template <int Steps, int Channels>
+bool GateSEQ<Steps, Channels>::generateRows(bool force) {
+	float values[Channels + 4] = {
+		params[STEPS_PARAM].value, inputs[STEPS_INPUT].value,
+		inputs[HITS_INPUT].value, inputs[ROTATE_INPUT].value
+	};
+	for (int y = 0; y < Channels; y++) {
+		values[4 + y] = params[HITS1_PARAM + y].value;
+	}
+	if (!force && pattern == generatedPattern && !memcmp(values, generatorInputs, sizeof(values))) {
+		return false;
+	}
+
+	Pattern<Steps, Channels> &p = bank.patterns[pattern];
+	int n = numSteps();
+	int hitsOffset = (int) roundf(inputs[HITS_INPUT].value);
+	int rotation = (int) roundf(inputs[ROTATE_INPUT].value) % n;
+	if (rotation < 0) {
+		rotation += n;
+	}
+	uint32_t masks[Channels];
+	bool changed = false;
+	for (int y = 0; y < Channels; y++) {
+		int hits = (int) roundf(params[HITS1_PARAM + y].value);
+		masks[y] = (hits == 0) ? p.rows[y] : euclid(n, clampi(hits + hitsOffset, 0, n), rotation);
+		changed |= masks[y] != p.rows[y];
+	}
+	if (changed) {
+		if (!bank.tryLock()) {
+			generatedPattern = -1;
+			return false;
+		}
+		memcpy(p.rows, masks, sizeof(masks));
+		bank.unlock();
+	}
+	memcpy(generatorInputs, values, sizeof(values));
+	generatedPattern = pattern;
+	return changed;
+}
+
+// Plays one sample of the pattern. `jump` is the step to go to on a new step
+// when stepped by a chain in steps mode, or Steps while another module plays;
+// -1 advances on our own.
+template <int Steps, int Channels>
+void GateSEQ<Steps, Channels>::play(bool nextStep, bool reset, bool active, int selected, int jump) {
+	#ifdef v_050_dev
+	float gSampleRate = engineGetSampleRate();
+	#endif
+	lightDecay.setSampleRate(gSampleRate);
+	if (reset) {
+		random.reset();
+		index = 999;
 		lights[RESET_LIGHT].value = 1.0;
 	}
+	if (selected >= 0 && selected != pattern) {
+		pattern = selected;
+		active = true;
+	}
+	// After the switch, so a new pattern's rows are generated before it plays
+	bool applied = bank.apply();
+	active |= applied;
+	active |= generateRows(applied);
+
+	// Idle fast path: without an edge, an edit, ratchets or fading lights,
+	// all outputs and lights stay as they are.
+	stepCounter++;
+	stats.samples++;
+	if (!nextStep && !active && activeSamples == 0 && !ratchet.active()) {
+		stats.idleSamples++;
+		return;
+	}
+
+	lights[RUNNING_LIGHT].value = running ? 1.0 : 0.0;
+	Pattern<Steps, Channels> &p = bank.patterns[pattern];
 
 	if (nextStep) {
 		// Advance step
-		int numSteps = clampi(roundf(params[STEPS_PARAM].value + inputs[STEPS_INPUT].value), 1, NUM_STEPS);
-		index += 1;
-		if (index >= numSteps) {
-			index = 0;
+		muted = (jump >= Steps);
+		if (jump < 0) {
+			index += 1;
+			if (index >= numSteps()) {
+				index = 0;
+			}
 		}
-		for (int y = 0; y < NUM_CHANNELS; y++) {
-			stepLights[y*NUM_STEPS + index] = 1.0;
+		else if (!muted) {
+			index = jump;
 		}
-	}
+		stepLength = stepCounter;
+		stepCounter = 0;
+		activeSamples = lightDecay.silence;
+		if (muted) {
+			ratchet.start(stepLength, 0);
+		}
+		else {
+			stepLights[index] = 1.0;
 
-	lights[RESET_LIGHT].value -= lights[RESET_LIGHT].value / lightLambda / gSampleRate;
+			// Roll the step's probability per channel, and split it into ratchets
+			StepSettings settings = p.steps[index];
+			skipped = 0;
+			for (int y = 0; y < Channels; y++) {
+				skipped |= (uint32_t) !settings.fires(random.next()) << y;
+			}
+			ratchet.start(stepLength, settings.ratchets);
+		}
+	}
+	uint32_t open = (ratchet.process() && !muted) ? ~skipped : 0;
 
-	// Gate buttons
-	for (int i = 0; i < NUM_GATES; i++) {
-		if (gateTriggers[i].process(params[GATE1_PARAM + i].value)) {
-			gateState[i] = !gateState[i];
+	if (activeSamples > 0 && --activeSamples == 0) {
+		// Faded out, snap to dark so the fast path can take over
+		lights[RESET_LIGHT].value = 0.0;
+		for (int x = 0; x < Steps; x++) {
+			stepLights[x] = 0.0;
 		}
-		stepLights[i] -= stepLights[i] / lightLambda / gSampleRate;
-		lights[GATE_LIGHTS + i].value = (gateState[i] >= 1.0) ? 1.0 - stepLights[i] : stepLights[i];
 	}
-	for (int y = 0; y < NUM_CHANNELS; y++) {
-		float gate = (gateState[y*NUM_STEPS + index] >= 1.0) ? 10.0 : 0.0;
+	lights[RESET_LIGHT].value = lightDecay.process(lights[RESET_LIGHT].value);
+	lightDecay.process(stepLights, Steps);
+	if (nextStep || active) {
+		revision.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	for (int y = 0; y < Channels; y++) {
+		// A muted module may not have a valid step yet after a reset
+		float gate = (((open >> y) & 1) && p.get(y, index)) ? 10.0 : 0.0;
 		outputs[GATE1_OUTPUT + y].value = gate;
 	}
 }
 
 
+template <class TModule>
 struct ClockMultiplierItem : MenuItem {
-	GateSEQ8 *gateSEQ8;
-	float multiplier;
+	TModule *gateSEQ;
+	int multiplier;
 	void onAction(EventAction &e) override {
-		gateSEQ8->multiplier = multiplier;
+		gateSEQ->multiplier = multiplier;
 	}
 };
 
+template <class TModule>
 struct ClockMultiplierChoice : ChoiceButton {
-	GateSEQ8 *gateSEQ8;
+	TModule *gateSEQ;
+	int shown = -1; // multiplier currently in `text`
 	void onAction(EventAction &e) override {
 		Menu *menu = gScene->createMenu();
 		menu->box.pos = getAbsoluteOffset(Vec(0, box.size.y));
 		menu->box.size.x = box.size.x;
 
-		const float multipliers[12] = {0.25, 0.3, 0.5, 0.75, 
-																	1.0, 1.5, 2.0, 3.0,
-																	4.0, 6.0, 8.0, 12.0};
-		const std::string labels[12] = {"1/4", "1/3", "1/2", "3/4", 
-																	 "1/1", "3/2", "2/1", "3/1",
-																 	 "4/1", "6/1", "8/1", "12/1"};
-		int multipliersLen = sizeof(multipliers) / sizeof(multipliers[0]);
-		for (int i = 0; i < multipliersLen; i++) {
-			ClockMultiplierItem *item = new ClockMultiplierItem();
-			item->gateSEQ8 = gateSEQ8;
-			item->multiplier = multipliers[i];
-			item->text = stringf("%.2f (%s)", multipliers[i], labels[i].c_str());
+		for (int i = 0; i < NUM_CLOCK_MULTIPLIERS; i++) {
+			ClockMultiplierItem<TModule> *item = new ClockMultiplierItem<TModule>();
+			item->gateSEQ = gateSEQ;
+			item->multiplier = i;
+			item->text = stringf("%.2f (%s)", clockMultipliers[i].value, clockMultipliers[i].label);
 			menu->addChild(item);
 		}
 	}
 	void step() override {
-		this->text = stringf("%.2f", gateSEQ8->multiplier);
+		if (gateSEQ->multiplier != shown) {
+			shown = gateSEQ->multiplier;
+			this->text = stringf("%.2f", clockMultipliers[shown].value);
+		}
+	}
+};
+
+template <class TModule>
+struct ClockSyncItem : MenuItem {
+	TModule *gateSEQ;
+	void onAction(EventAction &e) override {
+		gateSEQ->synced = !gateSEQ->synced;
+	}
+	void step() override {
+		rightText = gateSEQ->synced ? "✔" : "";
+	}
+};
+
+// The gate grid, drawn in a single pass into a framebuffer.
+// Each cell is a button with a light, 25px apart. The framebuffer is only
+// redrawn when the engine bumps its revision, or when a fading step light
+// crosses to a new brightness level.
+template <class TModule, int Steps, int Channels>
+struct GateGridDisplay : TransparentWidget {
+	static const int LEVELS = 16;
+
+	TModule *module;
+	int levels[Steps] = {};
+
+	void draw(NVGcontext *vg) override {
+		module->bank.lock();
+		Pattern<Steps, Channels> p = module->bank.read(module->pattern);
+		module->bank.unlock();
+		for (int y = 0; y < Channels; y++) {
+			for (int x = 0; x < Steps; x++) {
+				float light = (float) levels[x] / LEVELS;
+				float brightness = p.get(y, x) ? 1.0 - light : light;
+				nvgBeginPath(vg);
+				nvgRoundedRect(vg, x*25, y*25, 20, 20, 3);
+				nvgFillColor(vg, nvgRGB(0x30, 0x30, 0x30));
+				nvgFill(vg);
+				nvgBeginPath(vg);
+				nvgCircle(vg, x*25 + 10, y*25 + 10, 4);
+				nvgFillColor(vg, nvgRGBAf(0.0, 0.8, 0.0, 0.15 + 0.85 * brightness));
+				nvgFill(vg);
+			}
+		}
+	}
+};
+
+template <class TModule, int Steps, int Channels>
+struct GateGrid : OpaqueWidget {
+	TModule *module;
+	FramebufferWidget *framebuffer;
+	GateGridDisplay<TModule, Steps, Channels> *display;
+	uint32_t revision = 0;
+
+	GateGrid(TModule *module) : module(module) {
+		box.size = Vec(Steps*25, Channels*25);
+		framebuffer = new FramebufferWidget();
+		framebuffer->box.size = box.size;
+		addChild(framebuffer);
+		display = new GateGridDisplay<TModule, Steps, Channels>();
+		display->module = module;
+		display->box.size = box.size;
+		framebuffer->addChild(display);
+	}
+
+	void step() override {
+		uint32_t current = module->revision.load(std::memory_order_relaxed);
+		if (current != revision) {
+			revision = current;
+			framebuffer->dirty = true;
+		}
+		for (int x = 0; x < Steps; x++) {
+			int level = (int) ceilf(module->stepLights[x] * display->LEVELS);
+			if (level != display->levels[x]) {
+				display->levels[x] = level;
+				framebuffer->dirty = true;
+			}
+		}
+		OpaqueWidget::step();
+	}
+
+	void onMouseDown(EventMouseDown &e) override {
+		int x = (int) (e.pos.x / 25);
+		int y = (int) (e.pos.y / 25);
+		if (x < 0 || x >= Steps || y < 0 || y >= Channels) {
+			return;
+		}
+		e.consumed = true;
+		e.target = this;
+		// Toggle in the bank; the engine picks it up on its next step
+		module->bank.lock();
+		Pattern<Steps, Channels> p = module->bank.read(module->pattern);
+		p.toggle(y, x);
+		module->bank.write(module->pattern, p);
+		module->bank.unlock();
+	}
+};
+
+struct SnapTrimpot : Trimpot {
+	SnapTrimpot() {
+		snap = true;
 	}
 };
 
-GateSEQ8Widget::GateSEQ8Widget() {
-	GateSEQ8 *module = new GateSEQ8();
+// Lays out any grid size. Modules without their own panel artwork get a
+// plain panel with generated labels.
+template <int Steps, int Channels>
+GateSEQWidget<Steps, Channels>::GateSEQWidget(const char *panelFilename) {
+	typedef GateSEQ<Steps, Channels> TModule;
+	TModule *module = new TModule();
 	setModule(module);
-	box.size = Vec(360, 380);
+	// One column per step plus the outputs, rounded up to whole panel units
+	box.size = Vec(ceilf((60 + Steps*25) / 15.0) * 15, 380);
 
-	{
+	if (panelFilename) {
 		SVGPanel *panel = new SVGPanel();
 		panel->box.size = box.size;
-		panel->setBackground(SVG::load(assetPlugin(plugin, "res/GateSEQ8.svg")));
+		panel->setBackground(SVG::load(assetPlugin(plugin, panelFilename)));
 		addChild(panel);
+	} else {
+		Panel *panel = new LightPanel();
+		panel->box.size = box.size;
+		addChild(panel);
+
+		static const char *labels[5] = {"Clock", "Run", "Reset", "Steps", "Ext clk"};
+		static const Vec labelPos[5] = {Vec(17, 36), Vec(58, 36), Vec(92, 36), Vec(130, 36), Vec(48, 82)};
+		for (int i = 0; i < 5; i++) {
+			Label *label = new Label();
+			label->box.pos = labelPos[i];
+			label->text = labels[i];
+			addChild(label);
+		}
+		Label *title = new Label();
+		title->box.pos = Vec(box.size.x/2 - 35, 8);
+		title->text = stringf("GateSEQ-%d", Steps);
+		addChild(title);
+		for (int x = 0; x < Steps; x++) {
+			Label *label = new Label();
+			label->box.pos = Vec(24 + x*25, 132);
+			label->text = stringf("%d", x + 1);
+			addChild(label);
+		}
 	}
 
 	addChild(createScrew<ScrewSilver>(Vec(15, 0)));
@@ -218,18 +779,18 @@ GateSEQ8Widget::GateSEQ8Widget() {
 	addChild(createScrew<ScrewSilver>(Vec(15, 365)));
 	addChild(createScrew<ScrewSilver>(Vec(box.size.x-30, 365)));
 
-	addParam(createParam<RoundSmallBlackKnob>(Vec(17, 56), module, GateSEQ8::CLOCK_PARAM, -2.0, 10.0, 2.0));
-	addParam(createParam<LEDButton>(Vec(60, 61-1), module, GateSEQ8::RUN_PARAM, 0.0, 1.0, 0.0));
-	addChild(createLight<SmallLight<GreenLight>>(Vec(60+6, 61+5), module, GateSEQ8::RUNNING_LIGHT));
-	addParam(createParam<LEDButton>(Vec(98, 61-1), module, GateSEQ8::RESET_PARAM, 0.0, 1.0, 0.0));
-	addChild(createLight<SmallLight<GreenLight>>(Vec(98+6, 61+5), module, GateSEQ8::RESET_LIGHT));
-	addParam(createParam<RoundSmallBlackSnapKnob>(Vec(132, 56), module, GateSEQ8::STEPS_PARAM, 1.0, NUM_STEPS, NUM_STEPS));
+	addParam(createParam<RoundSmallBlackKnob>(Vec(17, 56), module, TModule::CLOCK_PARAM, -2.0, 10.0, 2.0));
+	addParam(createParam<LEDButton>(Vec(60, 61-1), module, TModule::RUN_PARAM, 0.0, 1.0, 0.0));
+	addChild(createLight<SmallLight<GreenLight>>(Vec(60+6, 61+5), module, TModule::RUNNING_LIGHT));
+	addParam(createParam<LEDButton>(Vec(98, 61-1), module, TModule::RESET_PARAM, 0.0, 1.0, 0.0));
+	addChild(createLight<SmallLight<GreenLight>>(Vec(98+6, 61+5), module, TModule::RESET_LIGHT));
+	addParam(createParam<RoundSmallBlackSnapKnob>(Vec(132, 56), module, TModule::STEPS_PARAM, 1.0, Steps, Steps));
 
 	static const float portX[8] = {19, 57, 96, 134, 173, 211, 250, 288};
-	addInput(createInput<PJ301MPort>(Vec(portX[0]-1, 99-1), module, GateSEQ8::CLOCK_INPUT));
-	addInput(createInput<PJ301MPort>(Vec(portX[1]-1, 99-1), module, GateSEQ8::EXT_CLOCK_INPUT));
-	addInput(createInput<PJ301MPort>(Vec(portX[2]-1, 99-1), module, GateSEQ8::RESET_INPUT));
-	addInput(createInput<PJ301MPort>(Vec(portX[3]-1, 99-1), module, GateSEQ8::STEPS_INPUT));
+	addInput(createInput<PJ301MPort>(Vec(portX[0]-1, 99-1), module, TModule::CLOCK_INPUT));
+	addInput(createInput<PJ301MPort>(Vec(portX[1]-1, 99-1), module, TModule::EXT_CLOCK_INPUT));
+	addInput(createInput<PJ301MPort>(Vec(portX[2]-1, 99-1), module, TModule::RESET_INPUT));
+	addInput(createInput<PJ301MPort>(Vec(portX[3]-1, 99-1), module, TModule::STEPS_INPUT));
 
 	{
 		Label *label = new Label();
@@ -237,19 +798,198 @@ GateSEQ8Widget::GateSEQ8Widget() {
 		label->text = "Clock multiplier";
 		addChild(label);
 
-		ClockMultiplierChoice *choice = new ClockMultiplierChoice();
-		choice->gateSEQ8 = dynamic_cast<GateSEQ8*>(module);
+		ClockMultiplierChoice<TModule> *choice = new ClockMultiplierChoice<TModule>();
+		choice->gateSEQ = module;
 		choice->box.pos = Vec(200, 70);
 		choice->box.size.x = 100;
 		addChild(choice);
 	}
 
-	for (int y = 0; y < NUM_CHANNELS; y++) {
-		for (int x = 0; x < NUM_STEPS; x++) {
-			int i = y*NUM_STEPS+x;
-			addParam(createParam<LEDButton>(Vec(22 + x*25, 155+y*25+3), module, GateSEQ8::GATE1_PARAM + i, 0.0, 1.0, 0.0));
-			addChild(createLight<SmallLight<GreenLight>>(Vec(28 + x*25, 156+y*25+8), module, GateSEQ8::GATE_LIGHTS + i));
+	{
+		Label *label = new Label();
+		label->box.pos = Vec(200, 104);
+		label->text = "Pattern";
+		addChild(label);
+
+		addParam(createParam<RoundSmallBlackSnapKnob>(Vec(250, 99), module, TModule::PATTERN_PARAM, 0.0, NUM_PATTERNS - 1, 0.0));
+		addInput(createInput<PJ301MPort>(Vec(portX[7]-1, 99-1), module, TModule::PATTERN_INPUT));
+	}
+
+	// Euclidean rows: a hit count per row, with CV for hits and rotation
+	{
+		Label *hitsLabel = new Label();
+		hitsLabel->box.pos = Vec(portX[4]-4, 82);
+		hitsLabel->text = "Hits";
+		addChild(hitsLabel);
+		addInput(createInput<PJ301MPort>(Vec(portX[4]-1, 99-1), module, TModule::HITS_INPUT));
+
+		Label *rotateLabel = new Label();
+		rotateLabel->box.pos = Vec(portX[7]+32, 82);
+		rotateLabel->text = "Rot";
+		addChild(rotateLabel);
+		addInput(createInput<PJ301MPort>(Vec(portX[7]+37, 99-1), module, TModule::ROTATE_INPUT));
+
+		for (int y = 0; y < Channels; y++) {
+			addParam(createParam<SnapTrimpot>(Vec(2, 159+y*25), module, TModule::HITS1_PARAM + y, 0.0, Steps, 0.0));
+		}
+	}
+
+	// Step settings, edited by clicking the step numbers
+	for (int x = 0; x < Steps; x++) {
+		StepSettingsButton *button = new StepSettingsButton();
+		button->box.pos = Vec(22 + x*25, 132);
+		button->box.size = Vec(20, 16);
+		button->step = x;
+		button->getSettings = [=]() {
+			module->bank.lock();
+			StepSettings settings = module->bank.read(module->pattern).steps[x];
+			module->bank.unlock();
+			return settings;
+		};
+		button->setSettings = [=](StepSettings settings) {
+			module->bank.lock();
+			Pattern<Steps, Channels> p = module->bank.read(module->pattern);
+			p.steps[x] = settings;
+			module->bank.write(module->pattern, p);
+			module->bank.unlock();
+		};
+		addChild(button);
+	}
+
+	GateGrid<TModule, Steps, Channels> *grid = new GateGrid<TModule, Steps, Channels>(module);
+	grid->box.pos = Vec(22, 158);
+	addChild(grid);
+
+	float outputX = box.size.x - 40;
+	for (int y = 0; y < Channels; y++) {
+		addOutput(createOutput<PJ301MPort>(Vec(outputX, 155+y*25), module, TModule::GATE1_OUTPUT + y));
+	}
+}
+
+// Unlinks us before the base class removes the module from the engine. The
+// engine may still be stepping the chain, but removal waits for that. Each
+// link is cut on the left before the module on the right is unmarked, and a
+// module that was stepped by the chain in the sample being played skips its
+// own step, so it's never played twice in a sample.
+template <int Steps, int Channels>
+GateSEQWidget<Steps, Channels>::~GateSEQWidget() {
+	typedef GateSEQ<Steps, Channels> TModule;
+	TModule *module = dynamic_cast<TModule*>(this->module);
+	if (!module) return;
+	if (module->chainPrev) {
+		module->chainPrev->chainNext.store(NULL, std::memory_order_release);
+		module->chainPrev = NULL;
+	}
+	TModule *next = module->chainNext.exchange(NULL, std::memory_order_release);
+	if (next) {
+		next->chainPrev = NULL;
+		next->chained = false;
+	}
+}
+
+// Links up with a GateSEQ of the same size placed right next to us. A link is
+// checked every frame; new neighbours are picked up a few frames later.
+template <int Steps, int Channels>
+void GateSEQWidget<Steps, Channels>::step() {
+	typedef GateSEQ<Steps, Channels> TModule;
+	TModule *module = dynamic_cast<TModule*>(this->module);
+	Vec pos = Vec(box.pos.x + box.size.x, box.pos.y);
+	auto adjacent = [=](Widget *w) {
+		return fabsf(w->box.pos.x - pos.x) < 1.0 && fabsf(w->box.pos.y - pos.y) < 1.0;
+	};
+
+	TModule *current = module->chainNext.load(std::memory_order_relaxed);
+	TModule *next = current;
+	ModuleWidget *nextWidget = chainNextWidget;
+	if (current && !adjacent(chainNextWidget)) {
+		next = NULL;
+	}
+	if (!next && --scanCounter <= 0) {
+		scanCounter = 15;
+		for (Widget *w : gRackWidget->moduleContainer->children) {
+			ModuleWidget *moduleWidget = dynamic_cast<ModuleWidget*>(w);
+			if (moduleWidget && moduleWidget != this && adjacent(w)) {
+				next = dynamic_cast<TModule*>(moduleWidget->module);
+				nextWidget = moduleWidget;
+				break;
+			}
+		}
+		if (next && next->chainPrev) {
+			// Already linked to a module we overlap with while being dragged
+			next = NULL;
+		}
+	}
+
+	if (next != current) {
+		if (current) {
+			module->chainNext.store(NULL, std::memory_order_release);
+			current->chainPrev = NULL;
+			current->chained = false;
+		}
+		if (next) {
+			// Mark it before linking, so it is never stepped twice in a sample
+			next->chainPrev = module;
+			next->chained = true;
+			module->chainNext.store(next, std::memory_order_release);
+			chainNextWidget = nextWidget;
 		}
-		addOutput(createOutput<PJ301MPort>(Vec(320, 155+y*25), module, GateSEQ8::GATE1_OUTPUT + y));
 	}
+	ModuleWidget::step();
+}
+
+template <class TModule>
+struct ChainModeItem : MenuItem {
+	TModule *gateSEQ;
+	int mode;
+	void onAction(EventAction &e) override {
+		gateSEQ->chainMode = mode;
+	}
+	void step() override {
+		rightText = (gateSEQ->chainMode == mode) ? "✔" : "";
+	}
+};
+
+template <int Steps, int Channels>
+Menu *GateSEQWidget<Steps, Channels>::createContextMenu() {
+	typedef GateSEQ<Steps, Channels> TModule;
+	Menu *menu = ModuleWidget::createContextMenu();
+
+	MenuLabel *spacerLabel = new MenuLabel();
+	menu->addChild(spacerLabel);
+
+	ClockSyncItem<TModule> *syncItem = new ClockSyncItem<TModule>();
+	syncItem->text = "Sync to shared clock";
+	syncItem->gateSEQ = dynamic_cast<TModule*>(module);
+	menu->addChild(syncItem);
+
+	static const char *chainModeNames[NUM_CHAIN_MODES] = {"Chain: more rows", "Chain: longer pattern"};
+	for (int i = 0; i < NUM_CHAIN_MODES; i++) {
+		ChainModeItem<TModule> *chainItem = new ChainModeItem<TModule>();
+		chainItem->text = chainModeNames[i];
+		chainItem->gateSEQ = syncItem->gateSEQ;
+		chainItem->mode = i;
+		menu->addChild(chainItem);
+	}
+
+	MenuLabel *statsLabel = new MenuLabel();
+	statsLabel->text = dynamic_cast<TModule*>(module)->stats.label();
+	menu->addChild(statsLabel);
+	appendTraceMenu(menu);
+
+	return menu;
+}
+
+GateSEQ8Widget::GateSEQ8Widget() :
+	GateSEQWidget<12, 8>("res/GateSEQ8.svg")
+{
+}
+
+GateSEQ16Widget::GateSEQ16Widget() :
+	GateSEQWidget<16, 8>()
+{
+}
+
+GateSEQ32Widget::GateSEQ32Widget() :
+	GateSEQWidget<32, 4>()
+{
 }
@@ -0,0 +1,45 @@
+#pragma once
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+
+// Exponential decay for step lights, shared by the sequencers.
+// Per sample, each value decays by `value / lambda / sampleRate`. That is the
+// same as multiplying by a constant coefficient, which we only recompute when
+// the sample rate changes.
+struct LightDecay {
+	float lambda;
+	float sampleRate = 0.0;
+	float coefficient = 1.0;
+	int silence = 1; // samples until a light at full brightness is invisible
+
+	LightDecay(float lambda) : lambda(lambda) {}
+
+	void setSampleRate(float sampleRate) {
+		if (sampleRate != this->sampleRate) {
+			this->sampleRate = sampleRate;
+			coefficient = 1.0 - 1.0 / (lambda * sampleRate);
+			silence = (coefficient > 0.0) ? (int) ceilf(logf(1e-3) / logf(coefficient)) : 1;
+		}
+	}
+
+	float process(float value) const {
+		return value * coefficient;
+	}
+
+	// Decays `count` values in place.
+	void process(float *values, int count) const {
+		int i = 0;
+#ifdef __SSE__
+		__m128 k = _mm_set1_ps(coefficient);
+		for (; i + 4 <= count; i += 4) {
+			_mm_storeu_ps(values + i, _mm_mul_ps(_mm_loadu_ps(values + i), k));
+		}
+#endif
+		for (; i < count; i++) {
+			values[i] *= coefficient;
+		}
+	}
+};
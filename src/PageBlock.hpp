@@ -0,0 +1,81 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+// A page-aligned heap block for audio buffers, allocated only while it is
+// in use. It is prefaulted on allocation, and optionally locked into RAM,
+// so the engine thread never page-faults on it.
+struct PageBlock {
+	void *data = NULL;
+	size_t size = 0;
+	bool locked = false;
+
+	~PageBlock() {
+		release();
+	}
+
+	static size_t pageSize() {
+#ifdef _WIN32
+		return 4096;
+#else
+		return sysconf(_SC_PAGESIZE);
+#endif
+	}
+
+	// Returns false if out of memory. Failing to lock is not an error, the
+	// block is then merely pageable.
+	bool allocate(size_t size, bool lock) {
+		release();
+		size_t page = pageSize();
+		size = (size + page - 1) / page * page;
+#ifdef _WIN32
+		data = _aligned_malloc(size, page);
+#else
+		if (posix_memalign(&data, page, size) != 0) data = NULL;
+#endif
+		if (!data) return false;
+		this->size = size;
+
+		// Touch every page now rather than on first use
+		memset(data, 0, size);
+		if (lock) {
+#ifdef _WIN32
+			locked = VirtualLock(data, size);
+#else
+			locked = (mlock(data, size) == 0);
+#endif
+			if (!locked) {
+				fprintf(stderr, "Failed to lock %zu bytes of buffer memory, continuing unlocked\n", size);
+			}
+		}
+		return true;
+	}
+
+	void release() {
+		if (!data) return;
+		if (locked) {
+#ifdef _WIN32
+			VirtualUnlock(data, size);
+#else
+			munlock(data, size);
+#endif
+		}
+#ifdef _WIN32
+		_aligned_free(data);
+#else
+		free(data);
+#endif
+		data = NULL;
+		size = 0;
+		locked = false;
+	}
+};
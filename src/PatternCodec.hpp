@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+
+// Compact patch storage for sequencer patterns.
+// Values of a fixed bit width are packed back to back, least significant
+// bit first, and stored as a hex string, one nibble per character.
+
+// Version 2 appends per-step settings to each pattern.
+const int PATTERN_FORMAT_VERSION = 2;
+
+struct BitWriter {
+	std::string hex;
+	uint32_t bits = 0;
+	int numBits = 0;
+
+	void write(uint32_t value, int width) {
+		for (int i = 0; i < width; i++) {
+			bits |= ((value >> i) & 1) << numBits;
+			if (++numBits == 4) {
+				flush();
+			}
+		}
+	}
+
+	const std::string &finish() {
+		if (numBits > 0) {
+			flush();
+		}
+		return hex;
+	}
+
+	void flush() {
+		hex += "0123456789abcdef"[bits];
+		bits = 0;
+		numBits = 0;
+	}
+};
+
+struct BitReader {
+	const char *hex;
+	uint32_t bits = 0;
+	int numBits = 0;
+
+	BitReader(const char *hex) : hex(hex ? hex : "") {}
+
+	// Returns false once the string is exhausted or not valid hex.
+	bool read(uint32_t *value, int width) {
+		uint32_t v = 0;
+		for (int i = 0; i < width; i++) {
+			if (numBits == 0 && !fill()) {
+				return false;
+			}
+			v |= (bits & 1) << i;
+			bits >>= 1;
+			numBits--;
+		}
+		*value = v;
+		return true;
+	}
+
+	bool fill() {
+		char c = *hex;
+		if (c >= '0' && c <= '9') {
+			bits = c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			bits = c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			bits = c - 'A' + 10;
+		} else {
+			return false;
+		}
+		hex++;
+		numBits = 4;
+		return true;
+	}
+};
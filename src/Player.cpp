@@ -0,0 +1,395 @@
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "dekstop.hpp"
+#include "PageBlock.hpp"
+#include "Trace.hpp"
+#include "../ext/osdialog/osdialog.h"
+#include "read_wav.h"
+#include "dsp/digital.hpp"
+
+#define RINGSIZE (64*1024) // frames, a power of two
+#define CHUNKSIZE 4096 // frames per prefetch read
+
+template <unsigned int ChannelCount>
+struct Player : Module {
+	enum ParamIds {
+		LOAD_PARAM,
+		PLAY_PARAM,
+		NUM_PARAMS
+	};
+	enum InputIds {
+		PLAY_INPUT,
+		SEEK_INPUT,
+		POSITION_INPUT,
+		NUM_INPUTS
+	};
+	enum OutputIds {
+		AUDIO1_OUTPUT,
+		NUM_OUTPUTS = AUDIO1_OUTPUT + ChannelCount
+	};
+	enum LightIds {
+		PLAYING_LIGHT,
+		NUM_LIGHTS
+	};
+
+	std::string filename;
+	WAV_Reader reader = {}; // the mapped file, read by the prefetch thread
+	std::atomic_bool isLoaded;
+	std::atomic_bool isPrefetching;
+	std::atomic<int64_t> numFrames;
+	std::thread thread;
+
+	// Single producer, single consumer ring of decoded frames. Positions
+	// only ever grow; the prefetch thread owns writePos, the engine readPos.
+	// The ring is allocated while a file is loaded, so an idle player holds
+	// no buffer memory; `mutex` guards it against the engine.
+	std::mutex mutex;
+	PageBlock memory;
+	float *ring = NULL;
+	std::atomic<uint64_t> writePos;
+	std::atomic<uint64_t> readPos;
+
+	// Seeks. The engine posts a target frame and bumps seekRequest. The
+	// prefetch thread moves its cursor, publishes the ring position where
+	// the new data starts and bumps flushCount, and only then marks the
+	// request done. The engine skips ahead to the flush, so the next frame
+	// played is exactly the target.
+	std::atomic<int64_t> seekTarget;
+	std::atomic<uint32_t> seekRequest;
+	std::atomic<uint32_t> seekDone;
+	std::atomic<uint64_t> flushStart;
+	std::atomic<uint32_t> flushCount;
+	std::atomic_bool atEnd;
+
+	// Frames played as silence because the prefetch thread fell behind,
+	// since the file was loaded. Written by the engine, shown in the menu.
+	std::atomic<uint64_t> underruns;
+
+	// Engine thread
+	bool isPlaying = false;
+	uint32_t seeks = 0; // requests posted
+	uint32_t flushesSeen = 0;
+	SchmittTrigger playTrigger;
+	SchmittTrigger seekTrigger;
+
+	Player() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS),
+		isLoaded(false), isPrefetching(false), numFrames(0), writePos(0), readPos(0),
+		seekTarget(0), seekRequest(0), seekDone(0), flushStart(0), flushCount(0), atEnd(false), underruns(0)
+	{
+	}
+	~Player();
+	void step();
+	void load(std::string path);
+	void unload();
+	void openDialog();
+	void prefetchRun();
+
+	json_t *toJson() {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "filename", json_string(filename.c_str()));
+		return rootJ;
+	}
+
+	void fromJson(json_t *rootJ) {
+		json_t *filenameJ = json_object_get(rootJ, "filename");
+		if (filenameJ && json_string_value(filenameJ)[0]) {
+			load(json_string_value(filenameJ));
+		}
+	}
+};
+
+template <unsigned int ChannelCount>
+Player<ChannelCount>::~Player() {
+	unload();
+}
+
+// UI thread
+template <unsigned int ChannelCount>
+void Player<ChannelCount>::load(std::string path) {
+	unload();
+	long result = Audio_WAV_OpenReader(&reader, path.c_str());
+	if (result < 0) {
+		char msg[100];
+		snprintf(msg, sizeof(msg), "Failed to open WAV file, result = %ld\n", result);
+		osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, msg);
+		fprintf(stderr, "%s", msg);
+		filename = "";
+		return;
+	}
+	if (!memory.allocate(sizeof(float) * RINGSIZE * ChannelCount, false)) {
+		osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, "Failed to allocate playback buffer");
+		Audio_WAV_CloseReader(&reader);
+		filename = "";
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ring = (float *) memory.data;
+	}
+	if (reader.truncated) {
+		fprintf(stderr, "%s is truncated, playing the %lld complete frames\n", path.c_str(), reader.numFrames);
+	}
+	filename = path;
+	numFrames = reader.numFrames;
+	underruns = 0;
+	isPrefetching = true;
+	thread = std::thread(&Player<ChannelCount>::prefetchRun, this);
+}
+
+template <unsigned int ChannelCount>
+void Player<ChannelCount>::unload() {
+	isLoaded = false;
+	if (isPrefetching) {
+		isPrefetching = false;
+		thread.join();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ring = NULL;
+		memory.release();
+	}
+	Audio_WAV_CloseReader(&reader);
+}
+
+template <unsigned int ChannelCount>
+void Player<ChannelCount>::openDialog() {
+	std::string dir = filename.empty() ? "." : extractDirectory(filename);
+	char *path = osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, NULL);
+	if (path) {
+		load(path);
+		free(path);
+	}
+}
+
+// Run in a separate thread. All file access happens here, including the
+// page faults of the memory map.
+template <unsigned int ChannelCount>
+void Player<ChannelCount>::prefetchRun() {
+	uint64_t w = writePos.load(std::memory_order_relaxed);
+	int64_t cursor = 0;
+
+	// Start from a clean ring; the engine skips whatever the last file left
+	uint32_t handled = seekRequest.load(std::memory_order_acquire);
+	flushStart.store(w, std::memory_order_relaxed);
+	flushCount.fetch_add(1, std::memory_order_release);
+	seekDone.store(handled, std::memory_order_release);
+	atEnd = false;
+	isLoaded = true;
+
+	while (isPrefetching) {
+		uint32_t request = seekRequest.load(std::memory_order_acquire);
+		if (request != handled) {
+			handled = request;
+			cursor = std::min<int64_t>(std::max<int64_t>(seekTarget.load(std::memory_order_relaxed), 0), reader.numFrames);
+			atEnd = false;
+			flushStart.store(w, std::memory_order_relaxed);
+			flushCount.fetch_add(1, std::memory_order_release);
+			seekDone.store(handled, std::memory_order_release);
+		}
+
+		uint64_t r = readPos.load(std::memory_order_acquire);
+		int64_t count = std::min<int64_t>(std::min<int64_t>(RINGSIZE - (w - r), CHUNKSIZE), reader.numFrames - cursor);
+		if (count <= 0) {
+			atEnd = (cursor >= reader.numFrames);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		// Fill up to the end of the ring, the rest on the next pass
+		int offset = w % RINGSIZE;
+		count = std::min<int64_t>(count, RINGSIZE - offset);
+		{
+			TRACE_SCOPE("Player read");
+			Audio_WAV_ReadFloats(&reader, cursor, count, &ring[offset * ChannelCount], ChannelCount);
+		}
+		TRACE_COUNTER("Player buffer fill", w + count - r);
+		cursor += count;
+		w += count;
+		writePos.store(w, std::memory_order_release);
+	}
+}
+
+template <unsigned int ChannelCount>
+void Player<ChannelCount>::step() {
+	TRACE_SAMPLED_SCOPE("Player::step", 256);
+	if (playTrigger.process(params[PLAY_PARAM].value + inputs[PLAY_INPUT].value)) {
+		isPlaying = !isPlaying;
+	}
+	if (seekTrigger.process(inputs[SEEK_INPUT].value)) {
+		// 0-10V spans the file. In double, since a float only holds whole
+		// frames up to 2^24, about six minutes at 44.1kHz.
+		float position = clampf(inputs[POSITION_INPUT].value / 10.0, 0.0, 1.0);
+		seekTarget.store((int64_t) ((double) position * numFrames.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+		seekRequest.store(++seeks, std::memory_order_release);
+	}
+	lights[PLAYING_LIGHT].value = isPlaying ? 1.0 : 0.0;
+
+	// Silent while load() or unload() holds the ring
+	std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+	bool ready = lock.owns_lock() && isLoaded.load(std::memory_order_acquire);
+	if (ready) {
+		// Read seekDone first: once it matches, the flush of that seek is
+		// visible below, so no frame from before the seek is played
+		uint32_t done = seekDone.load(std::memory_order_acquire);
+		uint32_t flushes = flushCount.load(std::memory_order_acquire);
+		if (flushes != flushesSeen) {
+			flushesSeen = flushes;
+			uint64_t start = flushStart.load(std::memory_order_relaxed);
+			if (readPos.load(std::memory_order_relaxed) < start) {
+				readPos.store(start, std::memory_order_release);
+			}
+		}
+		// Hold silence until the prefetch thread has caught up with a seek
+		ready = (done == seeks);
+	}
+
+	uint64_t r = readPos.load(std::memory_order_relaxed);
+	if (ready && isPlaying && r < writePos.load(std::memory_order_acquire)) {
+		const float *f = &ring[(r % RINGSIZE) * ChannelCount];
+		for (unsigned int i = 0; i < ChannelCount; i++) {
+			outputs[AUDIO1_OUTPUT + i].value = f[i] * 5.0;
+		}
+		readPos.store(r + 1, std::memory_order_release);
+		return;
+	}
+
+	if (ready && isPlaying) {
+		if (atEnd) {
+			isPlaying = false;
+		} else {
+			// Only the engine writes it, so no read-modify-write is needed
+			underruns.store(underruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	}
+	for (unsigned int i = 0; i < ChannelCount; i++) {
+		outputs[AUDIO1_OUTPUT + i].value = 0.0;
+	}
+}
+
+struct LoadButton : LEDButton {
+	using Callback = std::function<void()>;
+
+	Callback onPressCallback;
+	SchmittTrigger loadTrigger;
+
+	void onChange(EventChange &e) override {
+		if (loadTrigger.process(value)) {
+			assert (onPressCallback);
+			onPressCallback();
+		}
+	}
+};
+
+
+template <unsigned int ChannelCount>
+PlayerWidget<ChannelCount>::PlayerWidget() {
+	Player<ChannelCount> *module = new Player<ChannelCount>();
+	setModule(module);
+	box.size = Vec(15*6+5, 380);
+
+	{
+		Panel *panel = new LightPanel();
+		panel->box.size = box.size;
+		addChild(panel);
+	}
+
+	float margin = 5;
+	float labelHeight = 15;
+	float yPos = margin;
+	float xPos = margin;
+
+	{
+		Label *label = new Label();
+		label->box.pos = Vec(xPos, yPos);
+		label->text = "Player " + std::to_string(ChannelCount);
+		addChild(label);
+		yPos += labelHeight + margin;
+	}
+
+	{
+		Label *loadLabel = new Label();
+		loadLabel->box.pos = Vec(margin, yPos);
+		loadLabel->text = "Load";
+		addChild(loadLabel);
+		Label *playLabel = new Label();
+		playLabel->box.pos = Vec(50, yPos);
+		playLabel->text = "Play";
+		addChild(playLabel);
+		yPos += labelHeight + margin;
+
+		ParamWidget *loadButton = createParam<LoadButton>(Vec(10, yPos-1), module, Player<ChannelCount>::LOAD_PARAM, 0.0, 1.0, 0.0);
+		LoadButton *btn = dynamic_cast<LoadButton*>(loadButton);
+		btn->onPressCallback = [=]()
+		{
+			module->openDialog();
+		};
+		addParam(loadButton);
+		addParam(createParam<LEDButton>(Vec(55, yPos-1), module, Player<ChannelCount>::PLAY_PARAM, 0.0, 1.0, 0.0));
+		addChild(createLight<SmallLight<GreenLight>>(Vec(55+6, yPos+5), module, Player<ChannelCount>::PLAYING_LIGHT));
+		yPos += loadButton->box.size.y + 2*margin;
+	}
+
+	{
+		static const char *labels[3] = {"Play", "Seek", "Pos"};
+		for (int i = 0; i < 3; i++) {
+			Label *label = new Label();
+			label->box.pos = Vec(margin + i*30, yPos);
+			label->text = labels[i];
+			addChild(label);
+			addInput(createInput<PJ301MPort>(Vec(margin + i*30, yPos + labelHeight + margin), module, Player<ChannelCount>::PLAY_INPUT + i));
+		}
+		yPos += labelHeight + 40;
+	}
+
+	{
+		Label *label = new Label();
+		label->box.pos = Vec(margin, yPos);
+		label->text = "Channels";
+		addChild(label);
+		yPos += labelHeight + margin;
+	}
+
+	yPos += 5;
+	xPos = 10;
+	for (unsigned int i = 0; i < ChannelCount; i++) {
+		addOutput(createOutput<PJ3410Port>(Vec(xPos, yPos), module, Player<ChannelCount>::AUDIO1_OUTPUT + i));
+		Label *label = new Label();
+		label->box.pos = Vec(xPos + 4, yPos + 28);
+		label->text = stringf("%d", i + 1);
+		addChild(label);
+
+		if (i % 2 ==0) {
+			xPos += 37 + margin;
+		} else {
+			xPos = 10;
+			yPos += 40 + margin;
+		}
+	}
+}
+
+template <unsigned int ChannelCount>
+Menu *PlayerWidget<ChannelCount>::createContextMenu() {
+	Menu *menu = ModuleWidget::createContextMenu();
+
+	MenuLabel *spacerLabel = new MenuLabel();
+	menu->addChild(spacerLabel);
+
+	MenuLabel *underrunsLabel = new MenuLabel();
+	underrunsLabel->text = stringf("Underruns: %llu frames",
+		(unsigned long long) dynamic_cast<Player<ChannelCount>*>(module)->underruns.load());
+	menu->addChild(underrunsLabel);
+	appendTraceMenu(menu);
+	return menu;
+}
+
+Player2Widget::Player2Widget() :
+	PlayerWidget<2u>()
+{
+}
+
+Player8Widget::Player8Widget() :
+	PlayerWidget<8u>()
+{
+}
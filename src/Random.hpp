@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+
+
+// Per-module random number generator, a PCG32 (see pcg-random.org).
+// Much cheaper than the global randomf(), and private to one module, so the
+// seed saved in the patch reproduces the same sequence on every render.
+struct Random {
+	uint64_t seed = 0;
+	uint64_t state = 0;
+
+	void setSeed(uint64_t seed) {
+		this->seed = seed;
+		reset();
+	}
+
+	// Restarts the sequence from the current seed.
+	void reset() {
+		state = 0;
+		next();
+		state += seed;
+		next();
+	}
+
+	uint32_t next() {
+		uint64_t old = state;
+		state = old * 6364136223846793005ull + 1442695040888963407ull;
+		uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+		uint32_t rot = old >> 59;
+		return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+	}
+};
@@ -1,8 +1,18 @@
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <thread>
+#include <vector>
 
 #include "dekstop.hpp"
+#include "ChannelCapture.hpp"
+#include "ClockDomain.hpp"
+#include "PageBlock.hpp"
+#include "StreamSink.hpp"
+#include "ThreadPolicy.hpp"
+#include "Trace.hpp"
 #include "samplerate.h"
 #include "../ext/osdialog/osdialog.h"
 #include "write_wav.h"
@@ -12,9 +22,81 @@
 
 #define BLOCKSIZE 1024
 #define BUFFERSIZE 32*BLOCKSIZE
+#define WAKETHRESHOLD (BUFFERSIZE/4) // frames buffered before the writer is woken
 
+// Capture buffers of a recording session
 template <unsigned int ChannelCount>
-struct Recorder : Module {
+struct RecorderBuffers {
+	RingBuffer<Frame<ChannelCount>, BUFFERSIZE> buffer;
+	union {
+		short shorts[ChannelCount*BUFFERSIZE];
+		float floats[ChannelCount*BUFFERSIZE]; // for raw float streams, and split channels
+	} writeBuffer;
+	short cv[ChannelCount*(BUFFERSIZE/CV_DECIMATION + 1)]; // decimated CV channels
+};
+
+// Starts recorders of any size on the same engine frame. Pressing record on a
+// recorder with sync start enabled arms it; pressing it again on any armed
+// recorder schedules all armed ones to start a little later, on the same
+// frame of gClockDomain's counter. Each file notes that frame in its header.
+struct RecorderSync {
+	static const uint64_t ARMED = UINT64_MAX;
+
+	bool syncStart = false;
+	std::atomic<uint64_t> startFrame; // capture begins on this frame
+	std::atomic<uint64_t> startedAt; // frame of the first captured sample
+	std::atomic_bool capturing;
+	FrameFollower frames; // engine thread
+
+	RecorderSync();
+	virtual ~RecorderSync();
+	virtual bool recording() = 0;
+	virtual void stop() = 0;
+
+	bool armed() {
+		return recording() && startFrame.load() == ARMED;
+	}
+	// Engine thread, once per sample
+	uint64_t tickFrame() {
+		return frames.process();
+	}
+	static void startArmed(float sampleRate);
+	static void stopSynced();
+};
+
+// All recorders, UI thread only
+static std::vector<RecorderSync*> recorders;
+
+RecorderSync::RecorderSync() : startFrame(0), startedAt(0), capturing(false) {
+	recorders.push_back(this);
+}
+
+RecorderSync::~RecorderSync() {
+	recorders.erase(std::find(recorders.begin(), recorders.end(), this));
+}
+
+void RecorderSync::startArmed(float sampleRate) {
+	// Far enough ahead that the engine sees every recorder's start frame
+	// before it is due
+	uint64_t frame = gClockDomain.frame.load() + (uint64_t) (sampleRate / 10);
+	for (RecorderSync *recorder : recorders) {
+		if (recorder->syncStart && recorder->armed()) {
+			recorder->startFrame = frame;
+		}
+	}
+	TRACE_COUNTER("Synced recordings start frame", frame);
+}
+
+void RecorderSync::stopSynced() {
+	for (RecorderSync *recorder : recorders) {
+		if (recorder->syncStart && recorder->recording()) {
+			recorder->stop();
+		}
+	}
+}
+
+template <unsigned int ChannelCount>
+struct Recorder : Module, RecorderSync {
 	enum ParamIds {
 		RECORD_PARAM,
 		NUM_PARAMS
@@ -37,27 +119,136 @@ struct Recorder : Module {
 
 	std::mutex mutex;
 	std::thread thread;
-	RingBuffer<Frame<ChannelCount>, BUFFERSIZE> buffer;
-	short writeBuffer[ChannelCount*BUFFERSIZE];
+	// Allocated when a session starts and released when it stops, so idle
+	// recorders hold no buffer memory. Guarded by `mutex`.
+	PageBlock memory;
+	RecorderBuffers<ChannelCount> *buffers = NULL;
+	bool lockMemory = false; // mlock the buffers while recording
 
-	Recorder() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
+	// Streaming to a named pipe or socket instead of a file
+	bool streamMode = false;
+	int streamFormat = StreamSink::WAV_STREAM;
+	std::string streamPath;
+	bool streaming = false; // the mode of the current session
+	StreamSink sink;
+
+	// Per-input capture modes. Recording to a file splits the inputs into
+	// the main file and the sidecar files; streams always carry all inputs.
+	int captureModes[ChannelCount] = {};
+	int sessionModes[ChannelCount]; // of the current session
+	int audioChannels = ChannelCount;
+	int cvChannels = 0;
+	int gateChannels = 0;
+	WAV_Writer cvWriter;
+	FILE *gateFile = NULL;
+	CvDecimator decimators[ChannelCount];
+	GateChanges gates[ChannelCount];
+	uint64_t capturedFrames = 0;
+
+	// Frames lost because the buffer was full, or no stream reader was connected
+	std::atomic<uint64_t> droppedFrames;
+	uint64_t discardedFrames = 0;
+
+	// Renders faster than realtime: rather than dropping frames when the
+	// buffer is full, the engine waits until the writer has drained it.
+	bool lossless = false;
+	std::condition_variable drained;
+
+	// Writer thread scheduling
+	int writerPriority = PRIORITY_NORMAL;
+	bool writerAffinity = false; // keep the writer off the engine's CPU
+	std::atomic<int> engineCpu;
+
+	// The engine wakes the writer once WAKETHRESHOLD frames are buffered, and
+	// stamps the time under `mutex`. The writer measures how long it takes
+	// from there until the buffer is drained. Only the writer updates the
+	// stats; the UI may read a stale value.
+	std::condition_variable wakeup;
+	std::chrono::steady_clock::time_point notifiedAt;
+	struct {
+		uint64_t count = 0;
+		double total = 0.0; // seconds
+		double max = 0.0;
+	} latency;
+
+	Recorder() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS), droppedFrames(0), engineCpu(-1)
 	{
 		isRecording = false;
 	}
 	~Recorder();
 	void step();
+
+	bool recording() override {
+		return isRecording;
+	}
+	void stop() override {
+		stopRecording();
+	}
+	void pressRecord();
+
+	json_t *toJson() {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "lockMemory", json_boolean(lockMemory));
+		json_object_set_new(rootJ, "streamMode", json_boolean(streamMode));
+		json_object_set_new(rootJ, "streamFormat", json_integer(streamFormat));
+		json_object_set_new(rootJ, "writerPriority", json_integer(writerPriority));
+		json_object_set_new(rootJ, "writerAffinity", json_boolean(writerAffinity));
+		json_object_set_new(rootJ, "lossless", json_boolean(lossless));
+		json_object_set_new(rootJ, "syncStart", json_boolean(syncStart));
+		json_t *captureModesJ = json_array();
+		for (unsigned int i = 0; i < ChannelCount; i++) {
+			json_array_append_new(captureModesJ, json_integer(captureModes[i]));
+		}
+		json_object_set_new(rootJ, "captureModes", captureModesJ);
+		return rootJ;
+	}
+
+	void fromJson(json_t *rootJ) {
+		json_t *lockMemoryJ = json_object_get(rootJ, "lockMemory");
+		lockMemory = lockMemoryJ && json_is_true(lockMemoryJ);
+		json_t *streamModeJ = json_object_get(rootJ, "streamMode");
+		streamMode = streamModeJ && json_is_true(streamModeJ);
+		json_t *streamFormatJ = json_object_get(rootJ, "streamFormat");
+		streamFormat = streamFormatJ ? clampi(json_integer_value(streamFormatJ), 0, StreamSink::NUM_FORMATS - 1) : StreamSink::WAV_STREAM;
+		json_t *writerPriorityJ = json_object_get(rootJ, "writerPriority");
+		writerPriority = writerPriorityJ ? clampi(json_integer_value(writerPriorityJ), 0, NUM_PRIORITIES - 1) : PRIORITY_NORMAL;
+		json_t *writerAffinityJ = json_object_get(rootJ, "writerAffinity");
+		writerAffinity = writerAffinityJ && json_is_true(writerAffinityJ);
+		json_t *losslessJ = json_object_get(rootJ, "lossless");
+		lossless = losslessJ && json_is_true(losslessJ);
+		json_t *syncStartJ = json_object_get(rootJ, "syncStart");
+		syncStart = syncStartJ && json_is_true(syncStartJ);
+		json_t *captureModesJ = json_object_get(rootJ, "captureModes");
+		for (unsigned int i = 0; i < ChannelCount; i++) {
+			json_t *modeJ = json_array_get(captureModesJ, i);
+			captureModes[i] = modeJ ? clampi(json_integer_value(modeJ), 0, NUM_CAPTURE_MODES - 1) : CAPTURE_AUDIO;
+		}
+	}
+
+	std::string latencyLabel() const {
+		if (latency.count == 0) return "Wake-to-drain latency: n/a";
+		return stringf("Wake-to-drain latency: avg %.1f ms, max %.1f ms",
+			1000.0 * latency.total / latency.count, 1000.0 * latency.max);
+	}
+
+	bool allocateBuffers();
+	void releaseBuffers();
 	void clear();
 	void startRecording();
 	void stopRecording();
 	void saveAsDialog();
-	void openWAV();
+	void streamDialog();
+	bool openWAV();
 	void closeWAV();
+	bool openStream();
+	void closeStream();
+	int splitFrames(int numFrames);
 	void recorderRun();
 };
 
 template <unsigned int ChannelCount>
 Recorder<ChannelCount>::~Recorder() {
-	if (isRecording) stopRecording();
+	if (thread.joinable()) stopRecording();
 }
 
 template <unsigned int ChannelCount>
@@ -67,19 +258,101 @@ void Recorder<ChannelCount>::clear() {
 
 template <unsigned int ChannelCount>
 void Recorder<ChannelCount>::startRecording() {
-	saveAsDialog();
-	if (!filename.empty()) {
-		openWAV();
-		isRecording = true;
-		thread = std::thread(&Recorder<ChannelCount>::recorderRun, this);
+	if (thread.joinable()) {
+		// The last session ended on a write error
+		stopRecording();
+	}
+	streaming = streamMode;
+	if (streaming) {
+		streamDialog();
+	} else {
+		saveAsDialog();
+	}
+	if ((streaming ? streamPath : filename).empty() || !allocateBuffers()) {
+		return;
+	}
+	audioChannels = cvChannels = gateChannels = 0;
+	for (unsigned int i = 0; i < ChannelCount; i++) {
+		sessionModes[i] = streaming ? CAPTURE_AUDIO : captureModes[i];
+		audioChannels += (sessionModes[i] == CAPTURE_AUDIO);
+		cvChannels += (sessionModes[i] == CAPTURE_CV);
+		gateChannels += (sessionModes[i] == CAPTURE_GATE);
+		decimators[i] = CvDecimator();
+		gates[i] = GateChanges();
+	}
+	capturedFrames = 0;
+	if (!(streaming ? openStream() : openWAV())) {
+		releaseBuffers();
+		return;
+	}
+	droppedFrames = 0;
+	discardedFrames = 0;
+	latency.count = 0;
+	latency.total = latency.max = 0.0;
+	startFrame = syncStart ? ARMED : 0;
+	startedAt = 0;
+	capturing = false;
+	isRecording = true;
+	thread = std::thread(&Recorder<ChannelCount>::recorderRun, this);
+}
+
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::pressRecord() {
+	#ifdef v_050_dev
+	float gSampleRate = engineGetSampleRate();
+	#endif
+	if (!isRecording) {
+		startRecording();
+	}
+	else if (syncStart && armed()) {
+		startArmed(gSampleRate);
+	}
+	else if (syncStart) {
+		stopSynced();
+	}
+	else {
+		stopRecording();
 	}
 }
 
 template <unsigned int ChannelCount>
 void Recorder<ChannelCount>::stopRecording() {
-	isRecording = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isRecording = false;
+	}
+	wakeup.notify_one();
+	drained.notify_all();
 	thread.join();
-	closeWAV();
+	if (streaming) {
+		closeStream();
+	} else {
+		closeWAV();
+	}
+	releaseBuffers();
+	if (droppedFrames > 0 || discardedFrames > 0) {
+		fprintf(stderr, "Dropped %llu frames on buffer overflow, %llu while no stream reader was connected\n",
+			(unsigned long long) droppedFrames, (unsigned long long) discardedFrames);
+	}
+}
+
+template <unsigned int ChannelCount>
+bool Recorder<ChannelCount>::allocateBuffers() {
+	// Not recording yet, so the engine doesn't touch the block meanwhile
+	if (!memory.allocate(sizeof(RecorderBuffers<ChannelCount>), lockMemory)) {
+		osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, "Failed to allocate recording buffers");
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	buffers = new (memory.data) RecorderBuffers<ChannelCount>;
+	return true;
+}
+
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::releaseBuffers() {
+	std::lock_guard<std::mutex> lock(mutex);
+	buffers = NULL;
+	memory.release();
 }
 
 template <unsigned int ChannelCount>
@@ -95,27 +368,106 @@ void Recorder<ChannelCount>::saveAsDialog() {
 }
 
 template <unsigned int ChannelCount>
-void Recorder<ChannelCount>::openWAV() {
+void Recorder<ChannelCount>::streamDialog() {
+	std::string dir = streamPath.empty() ? "." : extractDirectory(streamPath);
+	char *path = osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, NULL);
+	if (path) {
+		streamPath = path;
+		free(path);
+	} else {
+		streamPath = "";
+	}
+}
+
+template <unsigned int ChannelCount>
+bool Recorder<ChannelCount>::openStream() {
+	#ifdef v_050_dev
+	float gSampleRate = engineGetSampleRate();
+	#endif
+	if (!sink.open(streamPath, (StreamSink::Format) streamFormat, ChannelCount, gSampleRate)) {
+		char msg[100];
+		snprintf(msg, sizeof(msg), "Can only stream to a named pipe or Unix domain socket\n");
+		osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, msg);
+		fprintf(stderr, "%s", msg);
+		return false;
+	}
+	return true;
+}
+
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::closeStream() {
+	fprintf(stdout, "Stopping the stream.\n");
+	sink.close();
+}
+
+template <unsigned int ChannelCount>
+bool Recorder<ChannelCount>::openWAV() {
 	#ifdef v_050_dev
 	float gSampleRate = engineGetSampleRate();
 	#endif
 	if (!filename.empty()) {
-		fprintf(stdout, "Recording to %s\n", filename.c_str());
-		int result = Audio_WAV_OpenWriter(&writer, filename.c_str(), gSampleRate, ChannelCount);
+		// Sidecar files are named after the main file
+		std::string base = filename;
+		if (base.size() > 4 && base.compare(base.size() - 4, 4, ".wav") == 0) {
+			base.resize(base.size() - 4);
+		}
+		int result = 0;
+		if (audioChannels > 0) {
+			fprintf(stdout, "Recording to %s\n", filename.c_str());
+			result = Audio_WAV_OpenBextWriter(&writer, filename.c_str(), gSampleRate, audioChannels, "dekstop Recorder");
+		}
+		if (result >= 0 && cvChannels > 0) {
+			std::string cvFilename = base + ".cv.wav";
+			fprintf(stdout, "Recording CV to %s\n", cvFilename.c_str());
+			result = Audio_WAV_OpenBextWriter(&cvWriter, cvFilename.c_str(), gSampleRate / CV_DECIMATION, cvChannels, "dekstop Recorder");
+			if (result < 0 && audioChannels > 0) {
+				Audio_WAV_CloseWriter(&writer);
+			}
+		}
+		if (result >= 0 && gateChannels > 0) {
+			std::string gateFilename = base + ".gates.csv";
+			fprintf(stdout, "Recording gates to %s\n", gateFilename.c_str());
+			gateFile = fopen(gateFilename.c_str(), "w");
+			if (gateFile) {
+				// Gates start low; each line is a change
+				fprintf(gateFile, "frame,input,gate\n");
+			} else {
+				result = -1;
+				if (audioChannels > 0) Audio_WAV_CloseWriter(&writer);
+				if (cvChannels > 0) Audio_WAV_CloseWriter(&cvWriter);
+			}
+		}
 		if (result < 0) {
 			isRecording = false;
 			char msg[100];
 			snprintf(msg, sizeof(msg), "Failed to open WAV file, result = %d\n", result);
 			osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, msg);
 			fprintf(stderr, "%s", msg);
+			return false;
 		} 
 	}
+	return true;
 }
 
 template <unsigned int ChannelCount>
 void Recorder<ChannelCount>::closeWAV() {
 	fprintf(stdout, "Stopping the recording.\n");
-	int result = Audio_WAV_CloseWriter(&writer);
+	// Timestamp the files with the engine frame the recording started on
+	uint64_t start = startedAt;
+	int result = 0;
+	if (audioChannels > 0) {
+		Audio_WAV_SetTimeReference(&writer, start);
+		result = Audio_WAV_CloseWriter(&writer);
+	}
+	if (cvChannels > 0) {
+		Audio_WAV_SetTimeReference(&cvWriter, start / CV_DECIMATION);
+		int cvResult = Audio_WAV_CloseWriter(&cvWriter);
+		result = std::min(result, cvResult);
+	}
+	if (gateFile) {
+		if (fclose(gateFile) != 0) result = std::min(result, -1);
+		gateFile = NULL;
+	}
 	if (result < 0) {
 		char msg[100];
 		snprintf(msg, sizeof(msg), "Failed to close WAV file, result = %d\n", result);
@@ -125,34 +477,162 @@ void Recorder<ChannelCount>::closeWAV() {
 	isRecording = false;
 }
 
+static inline short floatToShort(float x) {
+	return (short) lrintf(clampf(x, -1.0, 1.0) * 32767.0);
+}
+
+// Splits the float frames in the write buffer by capture mode: audio inputs
+// are packed as shorts for the main file, CV inputs are decimated into the
+// CV file, and gate changes are logged. Shorts are written behind the floats
+// still to be read, so the audio is converted in place. Returns a negative
+// error code if writing a sidecar file failed.
+template <unsigned int ChannelCount>
+int Recorder<ChannelCount>::splitFrames(int numFrames) {
+	const float *in = buffers->writeBuffer.floats;
+	short *audio = buffers->writeBuffer.shorts;
+	short *cv = buffers->cv;
+	int numCv = 0;
+	// Gate changes are stamped with their frame in the main file, which the
+	// audio of this block is appended to; without one, frames count from
+	// the start of the capture
+	uint64_t firstFrame = audioChannels > 0 ? (uint32_t) writer.dataSize / (2 * audioChannels) : capturedFrames;
+	for (int f = 0; f < numFrames; f++) {
+		float frame[ChannelCount];
+		memcpy(frame, in + f*ChannelCount, sizeof(frame));
+		for (unsigned int i = 0; i < ChannelCount; i++) {
+			float out;
+			switch (sessionModes[i]) {
+				case CAPTURE_AUDIO:
+					*audio++ = floatToShort(frame[i]);
+					break;
+				case CAPTURE_CV:
+					// Full scale is +-10V, rather than +-5V for audio
+					if (decimators[i].process(frame[i], &out)) {
+						cv[numCv++] = floatToShort(out / 2.0);
+					}
+					break;
+				case CAPTURE_GATE:
+					if (gates[i].process(frame[i] * 5.0)) {
+						fprintf(gateFile, "%llu,%u,%d\n", (unsigned long long) (firstFrame + f), i + 1, gates[i].high);
+					}
+					break;
+			}
+		}
+	}
+	capturedFrames += numFrames;
+
+	if (numCv > 0) {
+		int result = Audio_WAV_WriteShorts(&cvWriter, cv, numCv);
+		if (result < 0) return result;
+	}
+	if (gateFile && ferror(gateFile)) {
+		return -1;
+	}
+	return 0;
+}
+
 // Run in a separate thread
 template <unsigned int ChannelCount>
 void Recorder<ChannelCount>::recorderRun() {
 	#ifdef v_050_dev
 	float gSampleRate = engineGetSampleRate();
 	#endif
-	while (isRecording) {
-		// Wake up a few times a second, often enough to never overflow the buffer.
-		float sleepTime = (1.0 * BUFFERSIZE / gSampleRate) / 2.0;
-		std::this_thread::sleep_for(std::chrono::duration<float>(sleepTime));
-		if (buffer.full()) {
-			fprintf(stderr, "Recording buffer overflow. Can't write quickly enough to disk. Current buffer size: %d\n", BUFFERSIZE);
+	RingBuffer<Frame<ChannelCount>, BUFFERSIZE> &buffer = buffers->buffer;
+	short *writeBuffer = buffers->writeBuffer.shorts;
+	if (streaming) {
+		StreamSink::blockSigpipe();
+	}
+	if (!setThreadPriority(writerPriority)) {
+		fprintf(stderr, "Failed to set writer thread priority to %s\n", threadPriorityName(writerPriority));
+	}
+	int avoidedCpu = -1;
+
+	bool stopping = false;
+	while (!stopping) {
+		// Wait for the fill threshold, but wake up at least a few times a
+		// second in case the engine stalls or the threshold is never reached.
+		float timeout = (1.0 * BUFFERSIZE / gSampleRate) / 2.0;
+		int numFrames;
+		bool overflow;
+		bool notified;
+		std::chrono::steady_clock::time_point notifiedAt;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeup.wait_for(lock, std::chrono::duration<float>(timeout), [&]() {
+				return buffer.size() >= WAKETHRESHOLD || !isRecording;
+			});
+			TRACE_INSTANT("Recorder wakeup");
+			// Once stopped, this last pass writes what the engine captured
+			stopping = !isRecording;
+			overflow = buffer.full();
+			numFrames = buffer.size();
+			notified = (this->notifiedAt != std::chrono::steady_clock::time_point());
+			notifiedAt = this->notifiedAt;
+			this->notifiedAt = std::chrono::steady_clock::time_point();
+
+			// Convert float frames to shorts, and drain the buffer
+			if ((streaming && sink.format == StreamSink::RAW_FLOAT) || audioChannels < (int) ChannelCount) {
+				memcpy(buffers->writeBuffer.floats, buffer.data[0].samples, sizeof(float)*ChannelCount*numFrames);
+			} else {
+				src_float_to_short_array(static_cast<float*>(buffer.data[0].samples), writeBuffer, ChannelCount*numFrames);
+			}
+			buffer.start = 0;
+			buffer.end = 0;
 		}
-		// Check if there is data
-		int numFrames = buffer.size();
+		if (overflow && lossless) {
+			// Release the engine
+			drained.notify_all();
+		}
+		TRACE_COUNTER("Recorder buffer fill", numFrames);
+
+		if (notified) {
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - notifiedAt).count();
+			latency.count++;
+			latency.total += seconds;
+			latency.max = std::max(latency.max, seconds);
+			TRACE_COUNTER("Recorder wake-to-drain (us)", seconds * 1e6);
+		}
+		if (overflow && !lossless) {
+			fprintf(stderr, "Recording buffer overflow. Can't write quickly enough to disk. Current buffer size: %d, frames dropped: %llu\n",
+				BUFFERSIZE, (unsigned long long) droppedFrames);
+		}
+		if (writerAffinity && engineCpu != avoidedCpu) {
+			// Follow the engine thread if it migrated
+			avoidedCpu = engineCpu;
+			setThreadAffinityExcept(avoidedCpu);
+		}
+
 		if (numFrames > 0) {
-			// Convert float frames to shorts
+			int result = 0;
 			{
-				std::lock_guard<std::mutex> lock(mutex); // Lock during conversion
-				src_float_to_short_array(static_cast<float*>(buffer.data[0].samples), writeBuffer, ChannelCount*numFrames);
-				buffer.start = 0;
-				buffer.end = 0;
+				TRACE_SCOPE("Recorder write");
+				if (audioChannels < (int) ChannelCount) {
+					result = splitFrames(numFrames);
+				}
+				if (streaming) {
+					// One large write; a missing reader just loses the data.
+					// The last pass waits a little for the reader to take the
+					// tail, and what it leaves isn't counted as discarded.
+					size_t frameSize = ChannelCount * sink.bytesPerSample();
+					size_t written = sink.write(writeBuffer, frameSize*numFrames, isRecording);
+					if (!stopping) {
+						discardedFrames += numFrames - written / frameSize;
+					} else if (written < frameSize*numFrames) {
+						fprintf(stderr, "Stream reader didn't take the last %llu frames\n",
+							(unsigned long long) (numFrames - written / frameSize));
+					}
+				} else if (result >= 0 && audioChannels > 0) {
+					result = Audio_WAV_WriteShorts(&writer, writeBuffer, audioChannels*numFrames);
+				}
 			}
-
-			fprintf(stdout, "Writing %d frames to disk\n", numFrames);
-			int result = Audio_WAV_WriteShorts(&writer, writeBuffer, ChannelCount*numFrames);
 			if (result < 0) {
-				stopRecording();
+				// Stop here; the file is closed when the session is stopped
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					isRecording = false;
+				}
+				stopping = true;
+				drained.notify_all();
 
 				char msg[100];
 				snprintf(msg, sizeof(msg), "Failed to write WAV file, result = %d\n", result);
@@ -165,16 +645,42 @@ void Recorder<ChannelCount>::recorderRun() {
 
 template <unsigned int ChannelCount>
 void Recorder<ChannelCount>::step() {
+	TRACE_SAMPLED_SCOPE("Recorder::step", 256);
+	uint64_t frame = tickFrame();
+	if (isRecording && !capturing) {
+		// Armed, or scheduled to start
+		if (frame < startFrame.load(std::memory_order_relaxed)) {
+			lights[RECORDING_LIGHT].value = 0.3;
+			return;
+		}
+		startedAt.store(frame, std::memory_order_relaxed);
+		capturing = true;
+	}
 	lights[RECORDING_LIGHT].value = isRecording ? 1.0 : 0.0;
 	if (isRecording) {
 		// Read input samples into recording buffer
-		std::lock_guard<std::mutex> lock(mutex);
-		if (!buffer.full()) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (lossless && buffers && buffers->buffer.full()) {
+			// Throttle the engine to the writer's speed
+			TRACE_SCOPE("Recorder backpressure");
+			wakeup.notify_one();
+			drained.wait(lock, [&]() {
+				return !buffers || !buffers->buffer.full() || !isRecording;
+			});
+		}
+		if (buffers && !buffers->buffer.full()) {
 			Frame<ChannelCount> f;
 			for (unsigned int i = 0; i < ChannelCount; i++) {
 				f.samples[i] = inputs[AUDIO1_INPUT + i].value / 5.0;
 			}
-			buffer.push(f);
+			buffers->buffer.push(f);
+			if (buffers->buffer.size() == WAKETHRESHOLD) {
+				notifiedAt = std::chrono::steady_clock::now();
+				engineCpu.store(currentCpu(), std::memory_order_relaxed);
+				wakeup.notify_one();
+			}
+		} else {
+			droppedFrames.fetch_add(1, std::memory_order_relaxed);
 		}
 	}
 }
@@ -229,11 +735,7 @@ RecorderWidget<ChannelCount>::RecorderWidget() {
 
 		btn->onPressCallback = [=]()
 		{
-			if (!recorder->isRecording) {
-				recorder->startRecording();
-			} else {
-				recorder->stopRecording();
-			}
+			recorder->pressRecord();
 		};
 		addParam(recordButton);
 		addChild(createLight<SmallLight<RedLight>>(Vec(xPos+6, yPos+5), module, Recorder<ChannelCount>::RECORDING_LIGHT));
@@ -267,6 +769,162 @@ RecorderWidget<ChannelCount>::RecorderWidget() {
 	}
 }
 
+template <unsigned int ChannelCount>
+struct LockMemoryItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	void onAction(EventAction &e) override {
+		recorder->lockMemory = !recorder->lockMemory;
+	}
+	void step() override {
+		rightText = recorder->lockMemory ? "✔" : "";
+	}
+};
+
+template <unsigned int ChannelCount>
+struct StreamModeItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	void onAction(EventAction &e) override {
+		recorder->streamMode = !recorder->streamMode;
+	}
+	void step() override {
+		rightText = recorder->streamMode ? "✔" : "";
+	}
+};
+
+template <unsigned int ChannelCount>
+struct StreamFormatItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	int format;
+	void onAction(EventAction &e) override {
+		recorder->streamFormat = format;
+	}
+	void step() override {
+		rightText = (recorder->streamFormat == format) ? "✔" : "";
+	}
+};
+
+template <unsigned int ChannelCount>
+struct SyncStartItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	void onAction(EventAction &e) override {
+		recorder->syncStart = !recorder->syncStart;
+	}
+	void step() override {
+		rightText = recorder->syncStart ? "✔" : "";
+	}
+};
+
+template <unsigned int ChannelCount>
+struct LosslessItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	void onAction(EventAction &e) override {
+		recorder->lossless = !recorder->lossless;
+	}
+	void step() override {
+		rightText = recorder->lossless ? "✔" : "";
+	}
+};
+
+template <unsigned int ChannelCount>
+struct CaptureModeItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	int input;
+	void onAction(EventAction &e) override {
+		// Cycles through the modes; takes effect with the next recording
+		recorder->captureModes[input] = (recorder->captureModes[input] + 1) % NUM_CAPTURE_MODES;
+	}
+	void step() override {
+		text = stringf("Input %d: %s", input + 1, captureModeName(recorder->captureModes[input]));
+	}
+};
+
+template <unsigned int ChannelCount>
+struct WriterPriorityItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	int priority;
+	void onAction(EventAction &e) override {
+		recorder->writerPriority = priority;
+	}
+	void step() override {
+		rightText = (recorder->writerPriority == priority) ? "✔" : "";
+	}
+};
+
+template <unsigned int ChannelCount>
+struct WriterAffinityItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	void onAction(EventAction &e) override {
+		recorder->writerAffinity = !recorder->writerAffinity;
+	}
+	void step() override {
+		rightText = recorder->writerAffinity ? "✔" : "";
+	}
+};
+
+template <unsigned int ChannelCount>
+Menu *RecorderWidget<ChannelCount>::createContextMenu() {
+	Menu *menu = ModuleWidget::createContextMenu();
+
+	MenuLabel *spacerLabel = new MenuLabel();
+	menu->addChild(spacerLabel);
+
+	LockMemoryItem<ChannelCount> *lockItem = new LockMemoryItem<ChannelCount>();
+	lockItem->text = "Lock buffers in memory";
+	lockItem->recorder = dynamic_cast<Recorder<ChannelCount>*>(module);
+	menu->addChild(lockItem);
+
+	SyncStartItem<ChannelCount> *syncItem = new SyncStartItem<ChannelCount>();
+	syncItem->text = "Sync start with other recorders";
+	syncItem->recorder = lockItem->recorder;
+	menu->addChild(syncItem);
+
+	LosslessItem<ChannelCount> *losslessItem = new LosslessItem<ChannelCount>();
+	losslessItem->text = "Lossless (slow the engine down to the writer)";
+	losslessItem->recorder = lockItem->recorder;
+	menu->addChild(losslessItem);
+
+	StreamModeItem<ChannelCount> *streamItem = new StreamModeItem<ChannelCount>();
+	streamItem->text = "Stream to pipe or socket";
+	streamItem->recorder = lockItem->recorder;
+	menu->addChild(streamItem);
+
+	for (int i = 0; i < StreamSink::NUM_FORMATS; i++) {
+		StreamFormatItem<ChannelCount> *formatItem = new StreamFormatItem<ChannelCount>();
+		formatItem->text = stringf("Stream format: %s", StreamSink::formatName(i));
+		formatItem->recorder = lockItem->recorder;
+		formatItem->format = i;
+		menu->addChild(formatItem);
+	}
+
+	for (unsigned int i = 0; i < ChannelCount; i++) {
+		CaptureModeItem<ChannelCount> *captureItem = new CaptureModeItem<ChannelCount>();
+		captureItem->recorder = lockItem->recorder;
+		captureItem->input = i;
+		captureItem->step();
+		menu->addChild(captureItem);
+	}
+
+	for (int i = 0; i < NUM_PRIORITIES; i++) {
+		WriterPriorityItem<ChannelCount> *priorityItem = new WriterPriorityItem<ChannelCount>();
+		priorityItem->text = stringf("Writer priority: %s", threadPriorityName(i));
+		priorityItem->recorder = lockItem->recorder;
+		priorityItem->priority = i;
+		menu->addChild(priorityItem);
+	}
+
+	WriterAffinityItem<ChannelCount> *affinityItem = new WriterAffinityItem<ChannelCount>();
+	affinityItem->text = "Keep writer off the engine's CPU";
+	affinityItem->recorder = lockItem->recorder;
+	menu->addChild(affinityItem);
+
+	MenuLabel *latencyLabel = new MenuLabel();
+	latencyLabel->text = lockItem->recorder->latencyLabel();
+	menu->addChild(latencyLabel);
+
+	appendTraceMenu(menu);
+	return menu;
+}
+
 Recorder2Widget::Recorder2Widget() :
 	RecorderWidget<2u>()
 {
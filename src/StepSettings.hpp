@@ -0,0 +1,138 @@
+#pragma once
+#include <functional>
+#include <stdint.h>
+
+#include "rack.hpp"
+
+using namespace rack;
+
+
+// Per-step playback settings, stored alongside the gates of a pattern.
+// Zero is the default for both fields, so cleared patterns play every gate once.
+struct StepSettings {
+	uint8_t skip; // chance of skipping the step, in 1/256
+	uint8_t ratchets; // extra gates within the step, 0-3
+
+	bool isDefault() const {
+		return skip == 0 && ratchets == 0;
+	}
+	// Rolls the step's probability with 32 random bits.
+	bool fires(uint32_t random) const {
+		return (random >> 24) >= skip;
+	}
+};
+
+// Splits a step into evenly spaced gates.
+// Without ratchets, or before a step length is known, the gate stays open for
+// the whole step. The last ratcheted gate also stays open until the next step.
+struct Ratchet {
+	int length = 0; // samples per ratcheted gate, open and closed
+	int half = 0;
+	int counter = 0;
+	int remaining = 0; // gates left after the current one
+	bool reopening = false; // the last gate is yet to open
+
+	void start(int stepLength, int ratchets) {
+		length = ratchets ? stepLength / (ratchets + 1) : 0;
+		half = length / 2;
+		remaining = (half > 0) ? ratchets : 0;
+		counter = 0;
+		reopening = false;
+	}
+
+	// True until the last gate has opened, after which the output holds
+	bool active() const {
+		return remaining > 0 || reopening;
+	}
+
+	// Returns true while the gate is open.
+	bool process() {
+		if (remaining == 0) {
+			reopening = false;
+			return true;
+		}
+		bool open = counter < half;
+		if (++counter >= length) {
+			counter = 0;
+			remaining--;
+			reopening = (remaining == 0);
+		}
+		return open;
+	}
+};
+
+
+// Edits the settings of one step from a menu. Placed over the step number on
+// the panel, and marked with a dot while the step has non-default settings.
+struct StepSettingsButton : OpaqueWidget {
+	using Getter = std::function<StepSettings()>;
+	using Setter = std::function<void(StepSettings)>;
+
+	int step = 0;
+	Getter getSettings;
+	Setter setSettings;
+
+	void onMouseDown(EventMouseDown &e) override;
+	void draw(NVGcontext *vg) override {
+		if (!getSettings().isDefault()) {
+			nvgBeginPath(vg);
+			nvgCircle(vg, box.size.x - 2, 2, 2);
+			nvgFillColor(vg, nvgRGB(0x29, 0xb2, 0xef));
+			nvgFill(vg);
+		}
+	}
+};
+
+struct StepSkipItem : MenuItem {
+	StepSettingsButton *button;
+	uint8_t skip;
+	void onAction(EventAction &e) override {
+		StepSettings settings = button->getSettings();
+		settings.skip = skip;
+		button->setSettings(settings);
+	}
+	void step() override {
+		rightText = (button->getSettings().skip == skip) ? "✔" : "";
+	}
+};
+
+struct StepRatchetItem : MenuItem {
+	StepSettingsButton *button;
+	uint8_t ratchets;
+	void onAction(EventAction &e) override {
+		StepSettings settings = button->getSettings();
+		settings.ratchets = ratchets;
+		button->setSettings(settings);
+	}
+	void step() override {
+		rightText = (button->getSettings().ratchets == ratchets) ? "✔" : "";
+	}
+};
+
+inline void StepSettingsButton::onMouseDown(EventMouseDown &e) {
+	e.consumed = true;
+	e.target = this;
+
+	Menu *menu = gScene->createMenu();
+	menu->box.pos = getAbsoluteOffset(Vec(0, box.size.y));
+
+	MenuLabel *label = new MenuLabel();
+	label->text = stringf("Step %d", step + 1);
+	menu->addChild(label);
+
+	static const int probabilities[5] = {100, 75, 50, 25, 10};
+	for (int i = 0; i < 5; i++) {
+		StepSkipItem *item = new StepSkipItem();
+		item->button = this;
+		item->skip = (uint8_t) roundf((100 - probabilities[i]) * 256 / 100.0);
+		item->text = stringf("Probability %d%%", probabilities[i]);
+		menu->addChild(item);
+	}
+	for (int i = 0; i < 4; i++) {
+		StepRatchetItem *item = new StepRatchetItem();
+		item->button = this;
+		item->ratchets = i;
+		item->text = stringf("Ratchets x%d", i + 1);
+		menu->addChild(item);
+	}
+}
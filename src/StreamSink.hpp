@@ -0,0 +1,215 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+// Streams recorded audio into a named pipe or a Unix domain socket, e.g.
+// into an encoder or analysis process. The reader may come and go: when it
+// disconnects the sink closes its end, and reconnects on a later write once
+// a reader is back. Each new connection starts with a fresh header.
+struct StreamSink {
+	enum Format {
+		WAV_STREAM, // 16-bit WAV, with open-ended chunk sizes
+		RAW_INT16,
+		RAW_FLOAT,
+		NUM_FORMATS
+	};
+
+	std::string path;
+	Format format = WAV_STREAM;
+	int channels = 0;
+	int sampleRate = 0;
+	int fd = -1;
+	bool isSocket = false;
+	bool needHeader = false;
+
+	// Polls of 100 ms a stopped write waits for a stalled reader
+	static const int DRAIN_POLLS = 5;
+
+	~StreamSink() {
+		close();
+	}
+
+	static const char *formatName(int format) {
+		static const char *names[NUM_FORMATS] = {"WAV 16-bit", "Raw 16-bit", "Raw float"};
+		return names[format];
+	}
+
+	int bytesPerSample() const {
+		return (format == RAW_FLOAT) ? 4 : 2;
+	}
+
+	// Returns false unless `path` is a named pipe or a socket. A missing
+	// reader is fine, the sink connects once one shows up.
+	bool open(std::string path, Format format, int channels, int sampleRate) {
+		close();
+#ifdef _WIN32
+		return false;
+#else
+		struct stat st;
+		if (stat(path.c_str(), &st) < 0 || !(S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode))) {
+			return false;
+		}
+		this->path = path;
+		this->format = format;
+		this->channels = channels;
+		this->sampleRate = sampleRate;
+		isSocket = S_ISSOCK(st.st_mode);
+		return true;
+#endif
+	}
+
+	void close() {
+#ifndef _WIN32
+		if (fd >= 0) ::close(fd);
+#endif
+		fd = -1;
+	}
+
+	// The writer thread calls this once, so that a reader going away shows
+	// up as EPIPE rather than a SIGPIPE that kills the process.
+	static void blockSigpipe() {
+#ifndef _WIN32
+		sigset_t set;
+		sigemptyset(&set);
+		sigaddset(&set, SIGPIPE);
+		pthread_sigmask(SIG_BLOCK, &set, NULL);
+#endif
+	}
+
+	// Writes all of `data`, waiting for a slow reader as long as `running`
+	// is set. Once it's cleared, the tail of the stream still goes out, but
+	// only until the reader has taken nothing for DRAIN_POLLS polls. Returns
+	// the number of bytes written; less than `size` if there is no reader, or
+	// it went away or stalled.
+	size_t write(const void *data, size_t size, const std::atomic_bool &running) {
+		if (fd < 0 && !connect()) {
+			return 0;
+		}
+		if (needHeader) {
+			uint8_t header[44];
+			writeHeader(header);
+			if (writeAll(header, sizeof(header), running) < sizeof(header)) {
+				return 0;
+			}
+			needHeader = false;
+		}
+		return writeAll(data, size, running);
+	}
+
+#ifndef _WIN32
+	bool connect() {
+		if (isSocket) {
+			struct sockaddr_un addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sun_family = AF_UNIX;
+			if (path.size() >= sizeof(addr.sun_path)) return false;
+			strcpy(addr.sun_path, path.c_str());
+			fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fd < 0) return false;
+			if (::connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+				close();
+				return false;
+			}
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		} else {
+			// Fails with ENXIO while nobody has the pipe open for reading
+			fd = ::open(path.c_str(), O_WRONLY | O_NONBLOCK);
+			if (fd < 0) return false;
+		}
+		fprintf(stdout, "Streaming to %s\n", path.c_str());
+		needHeader = (format == WAV_STREAM);
+		return true;
+	}
+
+	size_t writeAll(const void *data, size_t size, const std::atomic_bool &running) {
+		size_t written = 0;
+		int idlePolls = 0;
+		while (written < size && (running || idlePolls < DRAIN_POLLS)) {
+			struct pollfd p = {fd, POLLOUT, 0};
+			if (poll(&p, 1, 100) == 0) {
+				// Reader is slow, keep waiting; the ring buffer absorbs it
+				idlePolls += !running;
+				continue;
+			}
+			ssize_t n = ::write(fd, (const char*) data + written, size - written);
+			if (n > 0) {
+				written += n;
+			}
+			else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+				continue;
+			}
+			else {
+				disconnect();
+				break;
+			}
+		}
+		return written;
+	}
+
+	void disconnect() {
+		fprintf(stdout, "Stream reader at %s went away\n", path.c_str());
+		close();
+		// Consume the SIGPIPE the failed write left pending
+		sigset_t pending;
+		sigpending(&pending);
+		if (sigismember(&pending, SIGPIPE)) {
+			sigset_t set;
+			int signal;
+			sigemptyset(&set);
+			sigaddset(&set, SIGPIPE);
+			sigwait(&set, &signal);
+		}
+	}
+#else
+	bool connect() {
+		return false;
+	}
+
+	size_t writeAll(const void *data, size_t size, const std::atomic_bool &running) {
+		return 0;
+	}
+#endif
+
+	// A WAV header with chunk sizes left at their maximum, which readers
+	// treat as "until the end of the stream".
+	void writeHeader(uint8_t *p) {
+		int bits = 16;
+		int blockAlign = channels * bits / 8;
+		memcpy(p, "RIFF", 4);
+		put32(p + 4, 0xFFFFFFFF);
+		memcpy(p + 8, "WAVEfmt ", 8);
+		put32(p + 16, 16);
+		put16(p + 20, 1); // PCM
+		put16(p + 22, channels);
+		put32(p + 24, sampleRate);
+		put32(p + 28, sampleRate * blockAlign);
+		put16(p + 32, blockAlign);
+		put16(p + 34, bits);
+		memcpy(p + 36, "data", 4);
+		put32(p + 40, 0xFFFFFFFF);
+	}
+
+	static void put16(uint8_t *p, uint32_t v) {
+		p[0] = v;
+		p[1] = v >> 8;
+	}
+	static void put32(uint8_t *p, uint32_t v) {
+		put16(p, v);
+		put16(p + 2, v >> 16);
+	}
+};
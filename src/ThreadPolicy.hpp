@@ -0,0 +1,82 @@
+#pragma once
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+// Scheduling controls for the plugin's background threads. All calls apply
+// to the calling thread, and return false where the OS doesn't support them
+// or refuses, e.g. realtime scheduling without the privileges for it.
+
+enum ThreadPriority {
+	PRIORITY_NORMAL,
+	PRIORITY_BATCH, // yields to interactive threads
+	PRIORITY_REALTIME, // lowest realtime priority, above all normal threads
+	NUM_PRIORITIES
+};
+
+inline const char *threadPriorityName(int priority) {
+	static const char *names[NUM_PRIORITIES] = {"Normal", "Low (batch)", "Realtime"};
+	return names[priority];
+}
+
+inline bool setThreadPriority(int priority) {
+#ifdef _WIN32
+	// Windows has no lowest realtime level within a normal process; HIGHEST
+	// is the closest, above normal threads but below the time critical ones
+	// audio drivers use
+	static const int levels[NUM_PRIORITIES] = {THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_HIGHEST};
+	return SetThreadPriority(GetCurrentThread(), levels[priority]);
+#else
+	struct sched_param param = {};
+	int policy = SCHED_OTHER;
+	if (priority == PRIORITY_BATCH) {
+#ifdef SCHED_BATCH
+		policy = SCHED_BATCH;
+#else
+		return false;
+#endif
+	}
+	else if (priority == PRIORITY_REALTIME) {
+		policy = SCHED_FIFO;
+		param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+	}
+	return pthread_setschedparam(pthread_self(), policy, &param) == 0;
+#endif
+}
+
+// The CPU the calling thread is running on, or -1 if unknown.
+inline int currentCpu() {
+#if defined(_WIN32)
+	return GetCurrentProcessorNumber();
+#elif defined(__linux__)
+	return sched_getcpu();
+#else
+	return -1;
+#endif
+}
+
+// Lets the calling thread run on any CPU but `cpu`, or any CPU at all if
+// `cpu` is -1.
+inline bool setThreadAffinityExcept(int cpu) {
+#if defined(_WIN32)
+	DWORD_PTR processMask, systemMask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) return false;
+	DWORD_PTR mask = processMask;
+	if (cpu >= 0 && cpu < (int) (8 * sizeof(mask))) mask &= ~((DWORD_PTR) 1 << cpu);
+	return mask && SetThreadAffinityMask(GetCurrentThread(), mask);
+#elif defined(__linux__)
+	// The kernel narrows this down to the CPUs the process may use
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (i != cpu) CPU_SET(i, &set);
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
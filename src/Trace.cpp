@@ -0,0 +1,109 @@
+#include "Trace.hpp"
+
+#ifdef DEKSTOP_TRACE
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+// Rings are never freed. When a thread exits its ring is marked unused,
+// and the next new thread takes it over, so restarting writer threads
+// doesn't grow memory.
+static std::mutex ringsMutex;
+static std::vector<TraceRing*> rings;
+static std::atomic_bool dumping(false);
+
+struct TraceRingOwner {
+	TraceRing *ring = NULL;
+	~TraceRingOwner() {
+		if (ring) ring->inUse = false;
+	}
+};
+
+TraceRing *traceRing() {
+	static thread_local TraceRingOwner owner;
+	if (!owner.ring) {
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		for (TraceRing *ring : rings) {
+			if (!ring->inUse) {
+				ring->inUse = true;
+				owner.ring = ring;
+				break;
+			}
+		}
+		if (!owner.ring) {
+			owner.ring = new TraceRing();
+			owner.ring->tid = rings.size() + 1;
+			rings.push_back(owner.ring);
+		}
+	}
+	return owner.ring;
+}
+
+// Copies the events still in the ring. The owning thread keeps writing
+// meanwhile, so events it overwrote during the copy are dropped.
+static void snapshot(TraceRing *ring, std::vector<TraceEvent> &events) {
+	uint64_t head = ring->head.load(std::memory_order_acquire);
+	uint64_t first = head > TraceRing::SIZE ? head - TraceRing::SIZE : 0;
+	std::vector<TraceEvent> copy;
+	for (uint64_t i = first; i < head; i++) {
+		copy.push_back(ring->events[i & (TraceRing::SIZE - 1)]);
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t after = ring->head.load(std::memory_order_relaxed);
+	uint64_t valid = after > TraceRing::SIZE ? after - TraceRing::SIZE : 0;
+	size_t skip = valid > first ? std::min<uint64_t>(valid - first, copy.size()) : 0;
+	events.assign(copy.begin() + skip, copy.end());
+}
+
+static void writeTrace(std::string path) {
+	std::vector<TraceRing*> current;
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		current = rings;
+	}
+
+	FILE *f = fopen(path.c_str(), "w");
+	if (!f) {
+		fprintf(stderr, "Failed to write trace to %s\n", path.c_str());
+		return;
+	}
+	fprintf(f, "{\"traceEvents\":[\n");
+	bool first = true;
+	std::vector<TraceEvent> events;
+	for (TraceRing *ring : current) {
+		snapshot(ring, events);
+		for (const TraceEvent &e : events) {
+			fprintf(f, first ? "" : ",\n");
+			first = false;
+			// Chrome trace timestamps are in microseconds
+			switch (e.type) {
+				case TRACE_SPAN:
+					fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+						e.name, ring->tid, e.time / 1000.0, e.value / 1000.0);
+					break;
+				case TRACE_INSTANT:
+					fprintf(f, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+						e.name, ring->tid, e.time / 1000.0);
+					break;
+				case TRACE_COUNTER:
+					fprintf(f, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+						e.name, ring->tid, e.time / 1000.0, (long long) e.value);
+					break;
+			}
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	fprintf(stdout, "Wrote trace to %s\n", path.c_str());
+}
+
+void traceDump(std::string path) {
+	if (dumping.exchange(true)) return;
+	std::thread([=]() {
+		writeTrace(path);
+		dumping = false;
+	}).detach();
+}
+
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+
+#include "rack.hpp"
+
+using namespace rack;
+
+
+// Low-overhead tracing of the plugin's hot paths, compiled in with
+// `-D DEKSTOP_TRACE` (see the Makefile). Without it, the macros below expand
+// to nothing.
+//
+// Each thread appends events to its own ring, which only it writes, so
+// recording an event is a few stores and no locks. Once a ring is full the
+// oldest events are overwritten. "Dump trace" in the context menu writes the
+// rings as Chrome trace JSON from a background thread; open the file in
+// chrome://tracing or Perfetto.
+#ifdef DEKSTOP_TRACE
+
+enum TraceType : uint8_t {
+	TRACE_SPAN,
+	TRACE_INSTANT,
+	TRACE_COUNTER
+};
+
+struct TraceEvent {
+	const char *name; // a string literal
+	uint64_t time; // monotonic, in ns
+	int64_t value; // duration in ns for spans, or the counter value
+	TraceType type;
+};
+
+struct TraceRing {
+	static const int SIZE = 16384; // events, a power of two
+
+	TraceEvent events[SIZE];
+	std::atomic<uint64_t> head; // events written so far
+	std::atomic_bool inUse;
+	int tid = 0;
+
+	TraceRing() : head(0), inUse(true) {}
+
+	void push(const char *name, uint64_t time, int64_t value, TraceType type) {
+		uint64_t h = head.load(std::memory_order_relaxed);
+		TraceEvent &e = events[h & (SIZE - 1)];
+		e.name = name;
+		e.time = time;
+		e.value = value;
+		e.type = type;
+		head.store(h + 1, std::memory_order_release);
+	}
+};
+
+// The calling thread's ring, set up on its first event.
+TraceRing *traceRing();
+
+// Writes all rings to `path` from a background thread. Ignored while a
+// previous dump is still running.
+void traceDump(std::string path);
+
+inline uint64_t traceNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Records the lifetime of the scope as a span, if `enabled`.
+struct TraceScope {
+	const char *name;
+	uint64_t start = 0;
+
+	TraceScope(const char *name, bool enabled = true) : name(enabled ? name : NULL) {
+		if (enabled) start = traceNow();
+	}
+	~TraceScope() {
+		if (name) {
+			uint64_t end = traceNow();
+			traceRing()->push(name, start, end - start, TRACE_SPAN);
+		}
+	}
+};
+
+#define TRACE_CONCAT_(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#define TRACE_SCOPE(name) \
+	TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+// Only every nth pass through the scope is recorded, for per-sample code.
+#define TRACE_SAMPLED_SCOPE(name, n) \
+	static thread_local uint32_t TRACE_CONCAT(traceCount, __LINE__) = 0; \
+	TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, TRACE_CONCAT(traceCount, __LINE__)++ % (n) == 0)
+#define TRACE_INSTANT(name) \
+	traceRing()->push(name, traceNow(), 0, TRACE_INSTANT)
+#define TRACE_COUNTER(name, value) \
+	traceRing()->push(name, traceNow(), (int64_t) (value), TRACE_COUNTER)
+
+struct TraceDumpItem : MenuItem {
+	void onAction(EventAction &e) override {
+		traceDump(assetLocal("dekstop-trace.json"));
+	}
+};
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_SAMPLED_SCOPE(name, n)
+#define TRACE_INSTANT(name)
+#define TRACE_COUNTER(name, value)
+
+#endif
+
+// Adds "Dump trace" to a module's context menu, when tracing is compiled in.
+inline void appendTraceMenu(Menu *menu) {
+#ifdef DEKSTOP_TRACE
+	TraceDumpItem *item = new TraceDumpItem();
+	item->text = "Dump trace";
+	menu->addChild(item);
+#endif
+}
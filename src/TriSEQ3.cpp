@@ -1,5 +1,12 @@
 #include "dekstop.hpp"
 #include "dsp/digital.hpp"
+#include "Clock.hpp"
+#include "FastPath.hpp"
+#include "LightDecay.hpp"
+#include "PatternCodec.hpp"
+#include "Random.hpp"
+#include "StepSettings.hpp"
+#include "Trace.hpp"
 
 struct TriSEQ3 : Module {
 	enum ParamIds {
@@ -41,34 +48,82 @@ struct TriSEQ3 : Module {
 	SchmittTrigger clockTrigger; // for external clock
 	SchmittTrigger runningTrigger;
 	SchmittTrigger resetTrigger;
-	float phase = 0.0;
+	InternalClock clock;
 	int index = 0;
 	SchmittTrigger gateTriggers[8];
 	bool gateState[8] = {};
+	StepSettings steps[8] = {};
+	Random random;
+	Ratchet ratchet;
+	bool skipped = false; // the gate was skipped this step
+	int stepLength = 0; // in samples, as last measured
+	int stepCounter = 0;
 	float stepLights[8] = {};
+	LightDecay lightDecay = LightDecay(0.1);
+	std::atomic<bool> edited; // set by the UI when the gates change
+	int activeSamples = 0; // until the step lights have faded
+	FastPathStats stats;
 
-	TriSEQ3() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS) {}
+	TriSEQ3() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS), edited(false) {
+		random.setSeed(randomu32());
+	}
 	void step();
 
 	json_t *toJson() {
 		json_t *rootJ = json_object();
 
-		json_t *gatesJ = json_array();
+		json_object_set_new(rootJ, "seed", json_integer((json_int_t) random.seed));
+
+		BitWriter writer;
+		for (int i = 0; i < 8; i++) {
+			writer.write(gateState[i], 1);
+		}
 		for (int i = 0; i < 8; i++) {
-			json_t *gateJ = json_integer((int) gateState[i]);
-			json_array_append_new(gatesJ, gateJ);
+			writer.write(steps[i].skip, 8);
+			writer.write(steps[i].ratchets, 2);
 		}
-		json_object_set_new(rootJ, "gates", gatesJ);
+		json_object_set_new(rootJ, "patternFormat", json_integer(PATTERN_FORMAT_VERSION));
+		json_object_set_new(rootJ, "patternData", json_string(writer.finish().c_str()));
 
 		return rootJ;
 	}
 
 	void fromJson(json_t *rootJ) {
-		json_t *gatesJ = json_object_get(rootJ, "gates");
-		for (int i = 0; i < 8; i++) {
-			json_t *gateJ = json_array_get(gatesJ, i);
-			gateState[i] = !!json_integer_value(gateJ);
+		json_t *seedJ = json_object_get(rootJ, "seed");
+		if (seedJ) {
+			random.setSeed((uint64_t) json_integer_value(seedJ));
+		}
+
+		json_t *formatJ = json_object_get(rootJ, "patternFormat");
+		json_t *dataJ = json_object_get(rootJ, "patternData");
+		if (formatJ && dataJ) {
+			int format = json_integer_value(formatJ);
+			if (format <= PATTERN_FORMAT_VERSION) {
+				BitReader reader(json_string_value(dataJ));
+				for (int i = 0; i < 8; i++) {
+					uint32_t gate = 0;
+					reader.read(&gate, 1);
+					gateState[i] = gate;
+				}
+				// Step settings were added in format 2
+				for (int i = 0; i < 8 && format >= 2; i++) {
+					uint32_t skip = 0, ratchets = 0;
+					reader.read(&skip, 8);
+					reader.read(&ratchets, 2);
+					steps[i].skip = skip;
+					steps[i].ratchets = ratchets;
+				}
+			}
+		}
+		else {
+			// Gate values, from older versions
+			json_t *gatesJ = json_object_get(rootJ, "gates");
+			for (int i = 0; i < 8; i++) {
+				json_t *gateJ = json_array_get(gatesJ, i);
+				gateState[i] = !!json_integer_value(gateJ);
+			}
 		}
+		edited.store(true, std::memory_order_relaxed);
 	}
 
 #ifdef v_050_dev
@@ -78,27 +133,37 @@ struct TriSEQ3 : Module {
 #endif
 		for (int i = 0; i < 8; i++) {
 			gateState[i] = false;
+			steps[i] = StepSettings();
 		}
+		edited.store(true, std::memory_order_relaxed);
 	}
 
 	void randomize() {
 		for (int i = 0; i < 8; i++) {
 			gateState[i] = (randomf() > 0.5);
 		}
+		edited.store(true, std::memory_order_relaxed);
 	}
 };
 
 
 void TriSEQ3::step() {
+	TRACE_SAMPLED_SCOPE("TriSEQ3::step", 256);
 	#ifdef v_050_dev
 	float gSampleRate = engineGetSampleRate();
 	#endif
-	const float lightLambda = 0.1;
+	lightDecay.setSampleRate(gSampleRate);
+	bool active = false;
+	if (edited.load(std::memory_order_relaxed)) {
+		edited.store(false, std::memory_order_relaxed);
+		active = true;
+	}
+
 	// Run
 	if (runningTrigger.process(params[RUN_PARAM].value)) {
 		running = !running;
+		active = true;
 	}
-	lights[RUNNING_LIGHT].value = running ? 1.0 : 0.0;
 
 	bool nextStep = false;
 
@@ -106,16 +171,13 @@ void TriSEQ3::step() {
 		if (inputs[EXT_CLOCK_INPUT].active) {
 			// External clock
 			if (clockTrigger.process(inputs[EXT_CLOCK_INPUT].value)) {
-				phase = 0.0;
+				clock.reset();
 				nextStep = true;
 			}
 		}
 		else {
 			// Internal clock
-			float clockTime = powf(2.0, params[CLOCK_PARAM].value + inputs[CLOCK_INPUT].value);
-			phase += clockTime / gSampleRate;
-			if (phase >= 1.0) {
-				phase -= 1.0;
+			if (clock.process(params[CLOCK_PARAM].value + inputs[CLOCK_INPUT].value, 1.0, gSampleRate)) {
 				nextStep = true;
 			}
 		}
@@ -123,7 +185,8 @@ void TriSEQ3::step() {
 
 	// Reset
 	if (resetTrigger.process(params[RESET_PARAM].value + inputs[RESET_INPUT].value)) {
-		phase = 0.0;
+		clock.reset();
+		random.reset();
 		index = 999;
 		nextStep = true;
 		lights[RESET_LIGHT].value = 1.0;
@@ -137,18 +200,48 @@ void TriSEQ3::step() {
 			index = 0;
 		}
 		stepLights[index] = 1.0;
+
+		// Roll the step's probability, and split it into ratchets
+		skipped = !steps[index].fires(random.next());
+		stepLength = stepCounter;
+		stepCounter = 0;
+		ratchet.start(stepLength, steps[index].ratchets);
+		activeSamples = lightDecay.silence;
+	}
+
+	// Idle fast path: without an edge, an edit, ratchets, fading lights or a
+	// moved row switch, all outputs and lights stay as they are.
+	stepCounter++;
+	stats.samples++;
+	if (!nextStep && !active && activeSamples == 0 && !ratchet.active()
+			&& index < 8
+			&& params[ROW1_PARAM + index].value == outputs[ROW1_OUTPUT].value
+			&& params[ROW2_PARAM + index].value == outputs[ROW2_OUTPUT].value
+			&& params[ROW3_PARAM + index].value == outputs[ROW3_OUTPUT].value) {
+		stats.idleSamples++;
+		return;
 	}
 
-	lights[RESET_LIGHT].value -= lights[RESET_LIGHT].value / lightLambda / gSampleRate;
+	lights[RUNNING_LIGHT].value = running ? 1.0 : 0.0;
+	bool open = ratchet.process() && !skipped;
+
+	if (activeSamples > 0 && --activeSamples == 0) {
+		// Faded out, snap to dark so the fast path can take over
+		lights[RESET_LIGHT].value = 0.0;
+		for (int i = 0; i < 8; i++) {
+			stepLights[i] = 0.0;
+		}
+	}
+	lights[RESET_LIGHT].value = lightDecay.process(lights[RESET_LIGHT].value);
+	lightDecay.process(stepLights, 8);
 
 	// Gate buttons
 	for (int i = 0; i < 8; i++) {
 		if (gateTriggers[i].process(params[GATE_PARAM + i].value)) {
 			gateState[i] = !gateState[i];
 		}
-		float gate = (i == index && gateState[i] >= 1.0) ? 10.0 : 0.0;
+		float gate = (i == index && gateState[i] >= 1.0 && open) ? 10.0 : 0.0;
 		outputs[GATE_OUTPUT + i].value = gate;
-		stepLights[i] -= stepLights[i] / lightLambda / gSampleRate;
 		lights[GATE_LIGHTS + i].value = (gateState[i] >= 1.0) ? 1.0 - stepLights[i] : stepLights[i];
 	}
 
@@ -156,7 +249,7 @@ void TriSEQ3::step() {
 	float row1 = params[ROW1_PARAM + index].value;
 	float row2 = params[ROW2_PARAM + index].value;
 	float row3 = params[ROW3_PARAM + index].value;
-	float gates = (gateState[index] >= 1.0) && !nextStep ? 10.0 : 0.0;
+	float gates = (gateState[index] >= 1.0) && !nextStep && open ? 10.0 : 0.0;
 	outputs[ROW1_OUTPUT].value = row1;
 	outputs[ROW2_OUTPUT].value = row2;
 	outputs[ROW3_OUTPUT].value = row3;
@@ -207,11 +300,38 @@ TriSEQ3Widget::TriSEQ3Widget() {
 	addOutput(createOutput<PJ301MPort>(Vec(portX[7]-1, 99-1), module, TriSEQ3::ROW3_OUTPUT));
 
 	for (int i = 0; i < 8; i++) {
+		// Step settings, edited by clicking the step numbers
+		StepSettingsButton *button = new StepSettingsButton();
+		button->box.pos = Vec(portX[i]+3, 139);
+		button->box.size = Vec(20, 13);
+		button->step = i;
+		button->getSettings = [=]() {
+			return module->steps[i];
+		};
+		button->setSettings = [=](StepSettings settings) {
+			module->steps[i] = settings;
+		};
+		addChild(button);
+
 		addParam(createParam<NKK>(Vec(portX[i]-3, 152), module, TriSEQ3::ROW1_PARAM + i, 0.0, 2.0, 0.0));
 		addParam(createParam<NKK>(Vec(portX[i]-3, 190), module, TriSEQ3::ROW2_PARAM + i, 0.0, 2.0, 0.0));
 		addParam(createParam<NKK>(Vec(portX[i]-3, 229), module, TriSEQ3::ROW3_PARAM + i, 0.0, 2.0, 0.0));
-		addParam(createParam<LEDButton>(Vec(portX[i]+2, 278-1), module, TriSEQ3::GATE_PARAM + i, 0.0, 1.0, 0.0));
+		addParam(createParam<EditButton<TriSEQ3>>(Vec(portX[i]+2, 278-1), module, TriSEQ3::GATE_PARAM + i, 0.0, 1.0, 0.0));
 		addChild(createLight<SmallLight<GreenLight>>(Vec(portX[i]+8, 278+5), module, TriSEQ3::GATE_LIGHTS + i));
 		addOutput(createOutput<PJ301MPort>(Vec(portX[i]-1, 308-1), module, TriSEQ3::GATE_OUTPUT + i));
 	}
 }
+
+Menu *TriSEQ3Widget::createContextMenu() {
+	Menu *menu = ModuleWidget::createContextMenu();
+
+	MenuLabel *spacerLabel = new MenuLabel();
+	menu->addChild(spacerLabel);
+
+	MenuLabel *statsLabel = new MenuLabel();
+	statsLabel->text = dynamic_cast<TriSEQ3*>(module)->stats.label();
+	menu->addChild(statsLabel);
+	appendTraceMenu(menu);
+
+	return menu;
+}
@@ -1,7 +1,9 @@
 #include "dekstop.hpp"
+#include "ClockDomain.hpp"
 #include <math.h>
 
 Plugin *plugin;
+ClockDomain gClockDomain;
 
 void init(rack::Plugin *p) {
 	plugin = p;
@@ -13,6 +15,10 @@ void init(rack::Plugin *p) {
 
 	p->addModel(createModel<TriSEQ3Widget>("dekstop", "TriSEQ3", "Tri-state SEQ-3", SEQUENCER_TAG));
 	p->addModel(createModel<GateSEQ8Widget>("dekstop", "GateSEQ8", "Gate SEQ-8", SEQUENCER_TAG));
+	p->addModel(createModel<GateSEQ16Widget>("dekstop", "GateSEQ16", "Gate SEQ-16", SEQUENCER_TAG));
+	p->addModel(createModel<GateSEQ32Widget>("dekstop", "GateSEQ32", "Gate SEQ-32", SEQUENCER_TAG));
 	p->addModel(createModel<Recorder2Widget>("dekstop", "Recorder2", "Recorder 2", UTILITY_TAG));
 	p->addModel(createModel<Recorder8Widget>("dekstop", "Recorder8", "Recorder 8", UTILITY_TAG));
+	p->addModel(createModel<Player2Widget>("dekstop", "Player2", "Player 2", UTILITY_TAG));
+	p->addModel(createModel<Player8Widget>("dekstop", "Player8", "Player 8", UTILITY_TAG));
 }
@@ -13,12 +13,34 @@ struct TriSEQ3Widget : ModuleWidget {
 	TriSEQ3Widget();
 	json_t *toJsonData();
 	void fromJsonData(json_t *root);
+	Menu *createContextMenu() override;
 };
 
-struct GateSEQ8Widget : ModuleWidget {
-	GateSEQ8Widget();
+template <int Steps, int Channels>
+struct GateSEQWidget : ModuleWidget {
+	ModuleWidget *chainNextWidget = NULL; // valid while our module is linked
+	int scanCounter = 0; // frames until we look for a chain neighbour again
+	GateSEQWidget(const char *panelFilename = NULL);
+	~GateSEQWidget();
 	json_t *toJsonData();
 	void fromJsonData(json_t *root);
+	void step() override;
+	Menu *createContextMenu() override;
+};
+
+struct GateSEQ8Widget : GateSEQWidget<12, 8>
+{
+	GateSEQ8Widget();
+};
+
+struct GateSEQ16Widget : GateSEQWidget<16, 8>
+{
+	GateSEQ16Widget();
+};
+
+struct GateSEQ32Widget : GateSEQWidget<32, 4>
+{
+	GateSEQ32Widget();
 };
 
 template <unsigned int ChannelCount>
@@ -26,6 +48,7 @@ struct RecorderWidget : ModuleWidget {
 	RecorderWidget();
 	json_t *toJsonData();
 	void fromJsonData(json_t *root);
+	Menu *createContextMenu() override;
 };
 
 struct Recorder2Widget : RecorderWidget<2u>
@@ -37,3 +60,19 @@ struct Recorder8Widget : RecorderWidget<8u>
 {
 	Recorder8Widget();
 };
+
+template <unsigned int ChannelCount>
+struct PlayerWidget : ModuleWidget {
+	PlayerWidget();
+	Menu *createContextMenu() override;
+};
+
+struct Player2Widget : PlayerWidget<2u>
+{
+	Player2Widget();
+};
+
+struct Player8Widget : PlayerWidget<8u>
+{
+	Player8Widget();
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+
+// Dialogs never open in the tests: messages go to stderr, and file choosers
+// return no path.
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	OSDIALOG_INFO,
+	OSDIALOG_WARNING,
+	OSDIALOG_ERROR,
+} osdialog_message_level;
+
+typedef enum {
+	OSDIALOG_OK,
+	OSDIALOG_OK_CANCEL,
+	OSDIALOG_YES_NO,
+} osdialog_message_buttons;
+
+typedef enum {
+	OSDIALOG_OPEN,
+	OSDIALOG_OPEN_DIR,
+	OSDIALOG_SAVE,
+} osdialog_file_action;
+
+typedef struct osdialog_filters osdialog_filters;
+
+int osdialog_message(osdialog_message_level level, osdialog_message_buttons buttons, const char *message);
+char *osdialog_file(osdialog_file_action action, const char *path, const char *filename, osdialog_filters *filters);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,46 @@
+#include "rack.hpp"
+#include "samplerate.h"
+#include "../ext/osdialog/osdialog.h"
+
+
+namespace rack {
+
+static Widget moduleContainer;
+
+static RackWidget *createRackWidget() {
+	RackWidget *rackWidget = new RackWidget();
+	rackWidget->moduleContainer = &moduleContainer;
+	return rackWidget;
+}
+
+Scene *gScene = new Scene();
+RackWidget *gRackWidget = createRackWidget();
+
+} // namespace rack
+
+extern "C" {
+
+int osdialog_message(osdialog_message_level level, osdialog_message_buttons buttons, const char *message) {
+	fprintf(stderr, "osdialog: %s", message);
+	return 0;
+}
+
+char *osdialog_file(osdialog_file_action action, const char *path, const char *filename, osdialog_filters *filters) {
+	return fake::dialogPath().empty() ? NULL : strdup(fake::dialogPath().c_str());
+}
+
+// As libsamplerate: full scale is 1.0, clipped
+void src_float_to_short_array(const float *in, short *out, int len) {
+	for (int i = 0; i < len; i++) {
+		long value = lrintf(in[i] * 32768.0f);
+		out[i] = (short) (value > 32767 ? 32767 : value < -32768 ? -32768 : value);
+	}
+}
+
+void src_short_to_float_array(const short *in, float *out, int len) {
+	for (int i = 0; i < len; i++) {
+		out[i] = in[i] / 32768.0f;
+	}
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+
+namespace rack {
+
+// As in Rack v0.5: fires on a rise to 1, rearms on a fall to 0.
+struct SchmittTrigger {
+	enum State {
+		UNKNOWN,
+		LOW,
+		HIGH
+	};
+	State state = UNKNOWN;
+	float low = 0.0;
+	float high = 1.0;
+
+	void setThresholds(float low, float high) {
+		this->low = low;
+		this->high = high;
+	}
+	bool process(float in) {
+		switch (state) {
+			case LOW:
+				if (in >= high) {
+					state = HIGH;
+					return true;
+				}
+				break;
+			case HIGH:
+				if (in <= low) {
+					state = LOW;
+				}
+				break;
+			default:
+				if (in >= high) {
+					state = HIGH;
+				}
+				else if (in <= low) {
+					state = LOW;
+				}
+				break;
+		}
+		return false;
+	}
+	bool isHigh() {
+		return state == HIGH;
+	}
+	void reset() {
+		state = UNKNOWN;
+	}
+};
+
+struct PulseGenerator {
+	float time = 0.0;
+	float pulseTime = 0.0;
+
+	bool process(float deltaTime) {
+		time += deltaTime;
+		return time < pulseTime;
+	}
+	void trigger(float pulseTime) {
+		time = 0.0;
+		this->pulseTime = pulseTime;
+	}
+};
+
+} // namespace rack
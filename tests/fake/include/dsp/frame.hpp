@@ -0,0 +1,12 @@
+#pragma once
+#include <stddef.h>
+
+
+namespace rack {
+
+template <size_t CHANNELS>
+struct Frame {
+	float samples[CHANNELS];
+};
+
+} // namespace rack
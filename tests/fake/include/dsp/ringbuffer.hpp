@@ -0,0 +1,41 @@
+#pragma once
+#include <stddef.h>
+
+
+namespace rack {
+
+// As in Rack v0.5: S must be a power of two, and the indices wrap.
+template <typename T, size_t S>
+struct RingBuffer {
+	T data[S];
+	size_t start = 0;
+	size_t end = 0;
+
+	size_t mask(size_t i) const {
+		return i & (S - 1);
+	}
+	void push(T t) {
+		size_t i = mask(end++);
+		data[i] = t;
+	}
+	T shift() {
+		return data[mask(start++)];
+	}
+	void clear() {
+		start = end;
+	}
+	bool empty() const {
+		return start == end;
+	}
+	bool full() const {
+		return end - start == S;
+	}
+	size_t size() const {
+		return end - start;
+	}
+	size_t capacity() const {
+		return S - size();
+	}
+};
+
+} // namespace rack
@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+
+
+// The subset of the jansson API used by the plugin, and by the tests to save
+// and load patches. See fake/jansson.cpp.
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct json_t json_t;
+typedef long long json_int_t;
+
+typedef struct {
+	int line;
+	char text[160];
+} json_error_t;
+
+#define JSON_COMPACT 0x20
+
+json_t *json_object(void);
+json_t *json_array(void);
+json_t *json_string(const char *value);
+json_t *json_stringn(const char *value, size_t len);
+json_t *json_integer(json_int_t value);
+json_t *json_real(double value);
+json_t *json_true(void);
+json_t *json_false(void);
+json_t *json_null(void);
+json_t *json_boolean(int value);
+void json_decref(json_t *json);
+
+int json_object_set_new(json_t *object, const char *key, json_t *value);
+json_t *json_object_get(const json_t *object, const char *key);
+int json_array_append_new(json_t *array, json_t *value);
+json_t *json_array_get(const json_t *array, size_t index);
+size_t json_array_size(const json_t *array);
+
+const char *json_string_value(const json_t *string);
+size_t json_string_length(const json_t *string);
+json_int_t json_integer_value(const json_t *integer);
+double json_real_value(const json_t *real);
+double json_number_value(const json_t *number);
+
+int json_is_object(const json_t *json);
+int json_is_array(const json_t *json);
+int json_is_string(const json_t *json);
+int json_is_integer(const json_t *json);
+int json_is_true(const json_t *json);
+
+// Returns a malloc'd string
+char *json_dumps(const json_t *json, size_t flags);
+json_t *json_loads(const char *input, size_t flags, json_error_t *error);
+
+#ifdef __cplusplus
+}
+#endif
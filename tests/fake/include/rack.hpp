@@ -0,0 +1,432 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <jansson.h>
+
+
+// Just enough of the Rack v0.5 API to build the plugin's modules without
+// the Rack SDK. Modules behave as in Rack; widgets are inert, and nothing is
+// ever drawn. The sample rate and the global RNG are set by the tests.
+
+struct NVGcontext;
+struct NVGcolor {
+	float r, g, b, a;
+};
+inline NVGcolor nvgRGBAf(float r, float g, float b, float a) { return NVGcolor{r, g, b, a}; }
+inline NVGcolor nvgRGBf(float r, float g, float b) { return nvgRGBAf(r, g, b, 1.0); }
+inline NVGcolor nvgRGBA(unsigned char r, unsigned char g, unsigned char b, unsigned char a) { return nvgRGBAf(r / 255.0, g / 255.0, b / 255.0, a / 255.0); }
+inline NVGcolor nvgRGB(unsigned char r, unsigned char g, unsigned char b) { return nvgRGBA(r, g, b, 255); }
+inline void nvgBeginPath(NVGcontext *) {}
+inline void nvgRect(NVGcontext *, float, float, float, float) {}
+inline void nvgRoundedRect(NVGcontext *, float, float, float, float, float) {}
+inline void nvgCircle(NVGcontext *, float, float, float) {}
+inline void nvgFillColor(NVGcontext *, NVGcolor) {}
+inline void nvgFill(NVGcontext *) {}
+inline void nvgStrokeColor(NVGcontext *, NVGcolor) {}
+inline void nvgStroke(NVGcontext *) {}
+inline void nvgStrokeWidth(NVGcontext *, float) {}
+
+#define TOSTRING(x) #x
+
+namespace fake {
+
+inline float &sampleRate() {
+	static float rate = 44100.0;
+	return rate;
+}
+
+// xorshift32, so that randomize() and new module seeds repeat across runs
+inline uint32_t &randomState() {
+	static uint32_t state = 1;
+	return state;
+}
+
+inline void seedRandom(uint32_t seed) {
+	randomState() = seed ? seed : 1;
+}
+
+// The path file dialogs return, or none if empty, as if cancelled
+inline std::string &dialogPath() {
+	static std::string path;
+	return path;
+}
+
+} // namespace fake
+
+namespace rack {
+
+struct Vec {
+	float x = 0.0, y = 0.0;
+	Vec() {}
+	Vec(float x, float y) : x(x), y(y) {}
+	Vec plus(Vec b) const { return Vec(x + b.x, y + b.y); }
+	Vec minus(Vec b) const { return Vec(x - b.x, y - b.y); }
+};
+
+struct Rect {
+	Vec pos, size;
+	bool contains(Vec v) const {
+		return v.x >= pos.x && v.x < pos.x + size.x && v.y >= pos.y && v.y < pos.y + size.y;
+	}
+};
+
+inline int clampi(int x, int a, int b) { return x < a ? a : x > b ? b : x; }
+inline float clampf(float x, float a, float b) { return x < a ? a : x > b ? b : x; }
+inline int mini(int a, int b) { return a < b ? a : b; }
+inline int maxi(int a, int b) { return a > b ? a : b; }
+
+inline uint32_t randomu32() {
+	uint32_t &x = fake::randomState();
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+inline float randomf() {
+	return (randomu32() >> 8) / 16777216.0;
+}
+
+inline std::string stringf(const char *format, ...) {
+	char buf[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	return buf;
+}
+
+inline std::string extractDirectory(std::string path) {
+	size_t pos = path.rfind('/');
+	return pos == std::string::npos ? "." : path.substr(0, pos);
+}
+
+inline std::string extractFilename(std::string path) {
+	size_t pos = path.rfind('/');
+	return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+struct Model {
+	std::string manufacturer, slug, name;
+};
+
+struct Plugin {
+	std::string slug, version, website;
+	std::vector<Model*> models;
+	void addModel(Model *model) { models.push_back(model); }
+};
+
+inline std::string assetPlugin(Plugin *plugin, std::string filename) { return filename; }
+inline std::string assetLocal(std::string filename) { return filename; }
+
+enum ModelTag {
+	SEQUENCER_TAG,
+	UTILITY_TAG,
+	RECORDING_TAG,
+	SAMPLER_TAG
+};
+
+struct Param {
+	float value = 0.0;
+};
+
+struct Input {
+	float value = 0.0;
+	bool active = false;
+};
+
+struct Output {
+	float value = 0.0;
+	bool active = false;
+};
+
+struct Light {
+	float value = 0.0;
+};
+
+struct Module {
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+
+	Module() {}
+	Module(int numParams, int numInputs, int numOutputs, int numLights = 0) {
+		params.resize(numParams);
+		inputs.resize(numInputs);
+		outputs.resize(numOutputs);
+		lights.resize(numLights);
+	}
+	virtual ~Module() {}
+	virtual void step() {}
+	virtual void onSampleRateChange() {}
+	virtual json_t *toJson() { return NULL; }
+	virtual void fromJson(json_t *root) {}
+	virtual void reset() {}
+	virtual void randomize() {}
+};
+
+inline float engineGetSampleRate() {
+	return fake::sampleRate();
+}
+
+struct Event {};
+struct EventConsumable {
+	bool consumed = false;
+};
+struct EventPosition : EventConsumable {
+	Vec pos;
+};
+struct Widget;
+struct EventMouseDown : EventPosition {
+	int button = 0;
+	Widget *target = NULL;
+};
+struct EventAction : EventConsumable {};
+struct EventChange : Event {};
+struct EventDragStart {};
+struct EventDragEnd {};
+struct EventDragMove {
+	Vec mouseRel;
+};
+
+struct Widget {
+	Rect box;
+	Widget *parent = NULL;
+	std::list<Widget*> children;
+
+	virtual ~Widget() {
+		for (Widget *child : children) {
+			delete child;
+		}
+	}
+	void addChild(Widget *widget) {
+		widget->parent = this;
+		children.push_back(widget);
+	}
+	void removeChild(Widget *widget) {
+		children.remove(widget);
+		widget->parent = NULL;
+	}
+	Vec getAbsoluteOffset(Vec v) {
+		for (Widget *w = this; w; w = w->parent) {
+			v = v.plus(w->box.pos);
+		}
+		return v;
+	}
+	virtual void step() {
+		for (Widget *child : children) {
+			child->step();
+		}
+	}
+	virtual void draw(NVGcontext *vg) {}
+	virtual void onMouseDown(EventMouseDown &e) {}
+	virtual void onAction(EventAction &e) {}
+	virtual void onChange(EventChange &e) {}
+	virtual void onDragStart(EventDragStart &e) {}
+	virtual void onDragEnd(EventDragEnd &e) {}
+	virtual void onDragMove(EventDragMove &e) {}
+};
+
+struct OpaqueWidget : virtual Widget {};
+struct TransparentWidget : virtual Widget {};
+struct FramebufferWidget : virtual Widget {
+	bool dirty = true;
+};
+
+struct SVG {
+	static std::shared_ptr<SVG> load(std::string filename) { return std::shared_ptr<SVG>(); }
+};
+struct SVGPanel : FramebufferWidget {
+	void setBackground(std::shared_ptr<SVG> svg) {}
+};
+struct Panel : TransparentWidget {
+	NVGcolor backgroundColor;
+};
+struct LightPanel : Panel {};
+struct Label : Widget {
+	std::string text;
+};
+
+struct MenuItem : OpaqueWidget {
+	std::string text, rightText;
+};
+struct MenuLabel : Widget {
+	std::string text;
+};
+struct MenuEntry : OpaqueWidget {
+	std::string text;
+};
+struct Menu : OpaqueWidget {
+	void pushChild(Widget *child) { addChild(child); }
+};
+
+struct Scene : OpaqueWidget {
+	Menu *createMenu() {
+		Menu *menu = new Menu();
+		addChild(menu);
+		return menu;
+	}
+};
+extern Scene *gScene;
+
+struct Button : OpaqueWidget {
+	std::string text;
+};
+struct ChoiceButton : Button {};
+struct Quantity {};
+
+struct ParamWidget : OpaqueWidget {
+	Module *module = NULL;
+	int paramId = 0;
+	float value = 0.0, minValue = 0.0, maxValue = 1.0, defaultValue = 0.0;
+	void setValue(float value) {
+		this->value = value;
+		EventChange e;
+		onChange(e);
+	}
+	void onChange(EventChange &e) override {
+		if (module) {
+			module->params[paramId].value = value;
+		}
+	}
+};
+struct SVGSwitch : virtual ParamWidget {};
+struct MomentarySwitch : virtual ParamWidget {};
+struct ToggleSwitch : virtual ParamWidget {};
+struct LEDButton : SVGSwitch, MomentarySwitch {};
+struct NKK : SVGSwitch, ToggleSwitch {};
+struct Knob : ParamWidget {
+	bool snap = false;
+};
+struct RoundSmallBlackKnob : Knob {};
+struct RoundSmallBlackSnapKnob : Knob {};
+struct Trimpot : Knob {};
+
+struct Port : OpaqueWidget {
+	Module *module = NULL;
+	int portId = 0;
+};
+struct PJ301MPort : Port {};
+struct PJ3410Port : Port {};
+
+struct LightWidget : TransparentWidget {};
+struct ModuleLightWidget : LightWidget {
+	Module *module = NULL;
+	int firstLightId = 0;
+};
+struct GreenLight : ModuleLightWidget {};
+struct RedLight : ModuleLightWidget {};
+template <class B> struct SmallLight : B {};
+template <class B> struct MediumLight : B {};
+template <class B> struct TinyLight : B {};
+
+struct Screw : Widget {};
+struct ScrewSilver : Screw {};
+
+struct ModuleWidget : OpaqueWidget {
+	Model *model = NULL;
+	Module *module = NULL;
+	std::vector<Port*> inputs, outputs;
+	std::vector<ParamWidget*> params;
+
+	~ModuleWidget() {
+		delete module;
+	}
+	void setModule(Module *module) { this->module = module; }
+	void addInput(Port *input) {
+		inputs.push_back(input);
+		addChild(input);
+	}
+	void addOutput(Port *output) {
+		outputs.push_back(output);
+		addChild(output);
+	}
+	void addParam(ParamWidget *param) {
+		params.push_back(param);
+		addChild(param);
+	}
+	virtual json_t *toJson() { return module ? module->toJson() : NULL; }
+	virtual void fromJson(json_t *root) {
+		if (module) module->fromJson(root);
+	}
+	virtual Menu *createContextMenu() { return gScene->createMenu(); }
+	virtual void reset() {
+		for (ParamWidget *param : params) {
+			param->setValue(param->defaultValue);
+		}
+		if (module) module->reset();
+	}
+	virtual void randomize() {
+		if (module) module->randomize();
+	}
+};
+
+struct RackWidget : OpaqueWidget {
+	Widget *moduleContainer = NULL;
+};
+extern RackWidget *gRackWidget;
+
+template <class T>
+T *createParam(Vec pos, Module *module, int paramId, float minValue, float maxValue, float defaultValue) {
+	T *param = new T();
+	param->box.pos = pos;
+	param->module = module;
+	param->paramId = paramId;
+	param->minValue = minValue;
+	param->maxValue = maxValue;
+	param->defaultValue = defaultValue;
+	param->setValue(defaultValue);
+	return param;
+}
+
+template <class T>
+T *createInput(Vec pos, Module *module, int inputId) {
+	T *port = new T();
+	port->box.pos = pos;
+	port->module = module;
+	port->portId = inputId;
+	return port;
+}
+
+template <class T>
+T *createOutput(Vec pos, Module *module, int outputId) {
+	return createInput<T>(pos, module, outputId);
+}
+
+template <class T>
+T *createLight(Vec pos, Module *module, int firstLightId) {
+	T *light = new T();
+	light->box.pos = pos;
+	light->module = module;
+	light->firstLightId = firstLightId;
+	return light;
+}
+
+template <class T>
+T *createScrew(Vec pos) {
+	T *screw = new T();
+	screw->box.pos = pos;
+	return screw;
+}
+
+template <class TModuleWidget>
+Model *createModel(std::string manufacturer, std::string slug, std::string name, ModelTag tag1 = SEQUENCER_TAG, ModelTag tag2 = SEQUENCER_TAG) {
+	Model *model = new Model();
+	model->manufacturer = manufacturer;
+	model->slug = slug;
+	model->name = name;
+	return model;
+}
+
+} // namespace rack
@@ -0,0 +1,13 @@
+#pragma once
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void src_float_to_short_array(const float *in, short *out, int len);
+void src_short_to_float_array(const short *in, float *out, int len);
+
+#ifdef __cplusplus
+}
+#endif
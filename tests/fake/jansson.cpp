@@ -0,0 +1,359 @@
+#include <jansson.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// A small JSON tree with the jansson API, so the tests can save and reload
+// patches, and measure how large they are, without linking jansson. Values
+// are owned by their parent; there is no reference counting.
+
+enum JsonType {
+	JSON_OBJECT,
+	JSON_ARRAY,
+	JSON_STRING,
+	JSON_INTEGER,
+	JSON_REAL,
+	JSON_TRUE,
+	JSON_FALSE,
+	JSON_NULL
+};
+
+struct json_t {
+	JsonType type;
+	std::string string;
+	json_int_t integer = 0;
+	double real = 0.0;
+	std::vector<std::pair<std::string, json_t*>> members; // objects
+	std::vector<json_t*> elements; // arrays
+
+	json_t(JsonType type) : type(type) {}
+	~json_t() {
+		for (auto &member : members) {
+			delete member.second;
+		}
+		for (json_t *element : elements) {
+			delete element;
+		}
+	}
+};
+
+extern "C" {
+
+json_t *json_object(void) { return new json_t(JSON_OBJECT); }
+json_t *json_array(void) { return new json_t(JSON_ARRAY); }
+json_t *json_true(void) { return new json_t(JSON_TRUE); }
+json_t *json_false(void) { return new json_t(JSON_FALSE); }
+json_t *json_null(void) { return new json_t(JSON_NULL); }
+json_t *json_boolean(int value) { return value ? json_true() : json_false(); }
+
+json_t *json_stringn(const char *value, size_t len) {
+	json_t *json = new json_t(JSON_STRING);
+	json->string.assign(value, len);
+	return json;
+}
+
+json_t *json_string(const char *value) {
+	return json_stringn(value, strlen(value));
+}
+
+json_t *json_integer(json_int_t value) {
+	json_t *json = new json_t(JSON_INTEGER);
+	json->integer = value;
+	return json;
+}
+
+json_t *json_real(double value) {
+	json_t *json = new json_t(JSON_REAL);
+	json->real = value;
+	return json;
+}
+
+void json_decref(json_t *json) {
+	delete json;
+}
+
+int json_object_set_new(json_t *object, const char *key, json_t *value) {
+	if (!object || object->type != JSON_OBJECT || !value) {
+		delete value;
+		return -1;
+	}
+	for (auto &member : object->members) {
+		if (member.first == key) {
+			delete member.second;
+			member.second = value;
+			return 0;
+		}
+	}
+	object->members.push_back(std::make_pair(std::string(key), value));
+	return 0;
+}
+
+json_t *json_object_get(const json_t *object, const char *key) {
+	if (!object || object->type != JSON_OBJECT) {
+		return NULL;
+	}
+	for (auto &member : object->members) {
+		if (member.first == key) {
+			return member.second;
+		}
+	}
+	return NULL;
+}
+
+int json_array_append_new(json_t *array, json_t *value) {
+	if (!array || array->type != JSON_ARRAY || !value) {
+		delete value;
+		return -1;
+	}
+	array->elements.push_back(value);
+	return 0;
+}
+
+json_t *json_array_get(const json_t *array, size_t index) {
+	if (!array || array->type != JSON_ARRAY || index >= array->elements.size()) {
+		return NULL;
+	}
+	return array->elements[index];
+}
+
+size_t json_array_size(const json_t *array) {
+	return (array && array->type == JSON_ARRAY) ? array->elements.size() : 0;
+}
+
+const char *json_string_value(const json_t *string) {
+	return (string && string->type == JSON_STRING) ? string->string.c_str() : NULL;
+}
+
+size_t json_string_length(const json_t *string) {
+	return (string && string->type == JSON_STRING) ? string->string.size() : 0;
+}
+
+json_int_t json_integer_value(const json_t *integer) {
+	return (integer && integer->type == JSON_INTEGER) ? integer->integer : 0;
+}
+
+double json_real_value(const json_t *real) {
+	return (real && real->type == JSON_REAL) ? real->real : 0.0;
+}
+
+double json_number_value(const json_t *number) {
+	if (number && number->type == JSON_INTEGER) {
+		return number->integer;
+	}
+	return json_real_value(number);
+}
+
+int json_is_object(const json_t *json) { return json && json->type == JSON_OBJECT; }
+int json_is_array(const json_t *json) { return json && json->type == JSON_ARRAY; }
+int json_is_string(const json_t *json) { return json && json->type == JSON_STRING; }
+int json_is_integer(const json_t *json) { return json && json->type == JSON_INTEGER; }
+int json_is_true(const json_t *json) { return json && json->type == JSON_TRUE; }
+
+} // extern "C"
+
+static void dumpString(const std::string &s, std::string &out) {
+	out += '"';
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char) c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		}
+		else {
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+// Matches jansson's output with JSON_COMPACT, or with an indent of 0
+static void dump(const json_t *json, bool compact, std::string &out) {
+	const char *separator = compact ? "," : ", ";
+	char buf[32];
+	switch (json->type) {
+		case JSON_OBJECT:
+			out += '{';
+			for (size_t i = 0; i < json->members.size(); i++) {
+				if (i > 0) out += separator;
+				dumpString(json->members[i].first, out);
+				out += compact ? ":" : ": ";
+				dump(json->members[i].second, compact, out);
+			}
+			out += '}';
+			break;
+		case JSON_ARRAY:
+			out += '[';
+			for (size_t i = 0; i < json->elements.size(); i++) {
+				if (i > 0) out += separator;
+				dump(json->elements[i], compact, out);
+			}
+			out += ']';
+			break;
+		case JSON_STRING:
+			dumpString(json->string, out);
+			break;
+		case JSON_INTEGER:
+			snprintf(buf, sizeof(buf), "%lld", json->integer);
+			out += buf;
+			break;
+		case JSON_REAL:
+			snprintf(buf, sizeof(buf), "%.17g", json->real);
+			if (!strpbrk(buf, ".eE")) strcat(buf, ".0");
+			out += buf;
+			break;
+		case JSON_TRUE: out += "true"; break;
+		case JSON_FALSE: out += "false"; break;
+		case JSON_NULL: out += "null"; break;
+	}
+}
+
+extern "C" char *json_dumps(const json_t *json, size_t flags) {
+	std::string out;
+	dump(json, flags & JSON_COMPACT, out);
+	return strdup(out.c_str());
+}
+
+struct Parser {
+	const char *p;
+
+	void skipSpace() {
+		while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+	}
+	bool parseString(std::string &s) {
+		if (*p != '"') return false;
+		p++;
+		while (*p && *p != '"') {
+			if (*p == '\\') {
+				p++;
+				switch (*p) {
+					case 'n': s += '\n'; break;
+					case 't': s += '\t'; break;
+					case 'r': s += '\r'; break;
+					case 'b': s += '\b'; break;
+					case 'f': s += '\f'; break;
+					case 'u': {
+						// Only the control characters that dump() escapes
+						unsigned int c = 0;
+						if (sscanf(p + 1, "%4x", &c) != 1) return false;
+						s += (char) c;
+						p += 4;
+						break;
+					}
+					case 0: return false;
+					default: s += *p; break;
+				}
+				p++;
+			}
+			else {
+				s += *p++;
+			}
+		}
+		if (*p != '"') return false;
+		p++;
+		return true;
+	}
+	json_t *parse() {
+		skipSpace();
+		if (*p == '{') {
+			p++;
+			json_t *object = json_object();
+			skipSpace();
+			if (*p == '}') {
+				p++;
+				return object;
+			}
+			while (true) {
+				skipSpace();
+				std::string key;
+				if (!parseString(key)) break;
+				skipSpace();
+				if (*p++ != ':') break;
+				json_t *value = parse();
+				if (!value) break;
+				json_object_set_new(object, key.c_str(), value);
+				skipSpace();
+				if (*p == ',') {
+					p++;
+					continue;
+				}
+				if (*p++ == '}') return object;
+				break;
+			}
+			delete object;
+			return NULL;
+		}
+		if (*p == '[') {
+			p++;
+			json_t *array = json_array();
+			skipSpace();
+			if (*p == ']') {
+				p++;
+				return array;
+			}
+			while (true) {
+				json_t *value = parse();
+				if (!value) break;
+				json_array_append_new(array, value);
+				skipSpace();
+				if (*p == ',') {
+					p++;
+					continue;
+				}
+				if (*p++ == ']') return array;
+				break;
+			}
+			delete array;
+			return NULL;
+		}
+		if (*p == '"') {
+			std::string s;
+			return parseString(s) ? json_stringn(s.data(), s.size()) : NULL;
+		}
+		if (!strncmp(p, "true", 4)) {
+			p += 4;
+			return json_true();
+		}
+		if (!strncmp(p, "false", 5)) {
+			p += 5;
+			return json_false();
+		}
+		if (!strncmp(p, "null", 4)) {
+			p += 4;
+			return json_null();
+		}
+		const char *start = p;
+		if (*p == '-') p++;
+		while (*p >= '0' && *p <= '9') p++;
+		if (p == start) return NULL;
+		if (*p == '.' || *p == 'e' || *p == 'E') {
+			return json_real(strtod(start, (char**) &p));
+		}
+		return json_integer(strtoll(start, NULL, 10));
+	}
+};
+
+extern "C" json_t *json_loads(const char *input, size_t flags, json_error_t *error) {
+	Parser parser = {input};
+	json_t *json = parser.parse();
+	if (json) {
+		parser.skipSpace();
+		if (*parser.p) {
+			delete json;
+			json = NULL;
+		}
+	}
+	if (!json && error) {
+		error->line = 1;
+		snprintf(error->text, sizeof(error->text), "parse error at offset %d", (int) (parser.p - input));
+	}
+	return json;
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Writes the WAV fixtures used by the tests. They are checked in; rerun this
+# only to change them, then update the tests that read them.
+
+import os
+import struct
+
+DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+def chunk(chunk_id, body):
+    # Chunks are padded to an even size; the pad byte is not counted
+    pad = b"\0" if len(body) % 2 else b""
+    return chunk_id + struct.pack("<I", len(body)) + body + pad
+
+
+def fmt_pcm16(channels, rate):
+    return chunk(b"fmt ", struct.pack("<HHIIHH", 1, channels, rate, rate * channels * 2, channels * 2, 16))
+
+
+def ramp16(frames, channels):
+    # Frame i holds i * 16 on the first channel, and its negation on the second
+    samples = []
+    for i in range(frames):
+        samples += [i * 16, -i * 16][:channels]
+    return struct.pack("<%dh" % len(samples), *samples)
+
+
+def write(name, data):
+    with open(os.path.join(DIR, name), "wb") as f:
+        f.write(data)
+
+
+def riff(chunks):
+    body = b"WAVE" + b"".join(chunks)
+    return b"RIFF" + struct.pack("<I", len(body)) + body
+
+
+# Plain stereo 16-bit file, for the Player tests
+write("stereo16.wav", riff([fmt_pcm16(2, 44100), chunk(b"data", ramp16(1000, 2))]))
+
+
+# RF64 with the sizes in a ds64 chunk, and 0xFFFFFFFF in the RIFF and data
+# headers, as written for files over 4GB
+data = ramp16(1000, 2)
+ds64 = chunk(b"ds64", struct.pack("<QQQI", 0, len(data), 1000, 0))
+body = b"WAVE" + ds64 + fmt_pcm16(2, 44100) + b"data" + struct.pack("<I", 0xFFFFFFFF) + data
+write("rf64.wav", b"RF64" + struct.pack("<I", 0xFFFFFFFF) + body)
+
+# Broadcast Wave: a bext chunk ahead of the data, with TimeReference at
+# offset 338 of its 602 byte body
+bext = bytearray(602)
+bext[0:7] = b"fixture"
+bext[338:346] = struct.pack("<Q", 5 * 2**32 + 17)
+write("bext.wav", riff([fmt_pcm16(2, 48000), chunk(b"bext", bytes(bext)), chunk(b"data", ramp16(100, 2))]))
+
+# An odd-sized chunk followed by its pad byte, then an odd-sized data chunk
+# of mono frames with one stray byte
+write("odd_chunk.wav", riff([chunk(b"LIST", b"INFOabc"), fmt_pcm16(1, 44100), chunk(b"data", ramp16(50, 1) + b"\x7f")]))
+
+# Cut off inside the data: the header claims 1000 frames, 400 and a half
+# are present
+data = ramp16(1000, 2)
+header = riff([fmt_pcm16(2, 44100), chunk(b"data", data)])
+write("truncated.wav", header[:len(header) - len(data) + 400 * 4 + 2])
+
+# Never finalized: the RIFF and data sizes are still zero
+data = ramp16(300, 2)
+write("unfinalized.wav", b"RIFF" + struct.pack("<I", 0) + b"WAVE" + fmt_pcm16(2, 44100) + b"data" + struct.pack("<I", 0) + data)
@@ -0,0 +1,115 @@
+#pragma once
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "rack.hpp"
+
+using namespace rack;
+
+
+// Headless test runner for the plugin's modules. Each test drives a module's
+// step() with fixed inputs at a fixed sample rate, and either checks its
+// outputs directly or compares a trace of them with a checked-in golden file.
+// Benchmarks report the time per step() in ns per sample.
+
+struct TestCase {
+	const char *name;
+	void (*run)();
+};
+
+std::vector<TestCase> &testCases();
+
+struct TestRegistrar {
+	TestRegistrar(const char *name, void (*run)()) {
+		testCases().push_back(TestCase{name, run});
+	}
+};
+
+#define TEST(name) \
+	static void test_##name(); \
+	static TestRegistrar registrar_##name(#name, test_##name); \
+	static void test_##name()
+
+void fail(const char *file, int line, const std::string &message);
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) fail(__FILE__, __LINE__, #cond); \
+	} while (0)
+
+#define CHECK_EQ(a, b) \
+	do { \
+		auto a_ = (a); \
+		auto b_ = (b); \
+		if (!(a_ == b_)) { \
+			std::ostringstream s_; \
+			s_ << #a " == " #b " (" << a_ << " vs " << b_ << ")"; \
+			fail(__FILE__, __LINE__, s_.str()); \
+		} \
+	} while (0)
+
+// Compares `trace` with golden/<name>.txt. Run with UPDATE_GOLDEN=1 to
+// rewrite the golden file instead, after a deliberate change in behaviour.
+void checkGolden(const char *name, const std::string &trace);
+
+// Prints a benchmark result, in ns per sample.
+void report(const char *name, double nsPerSample);
+// Prints any other measurement.
+void report(const char *name, double value, const char *unit);
+
+// Runs `step` for `samples` samples and returns the mean time per call in ns.
+template <typename F>
+double benchmark(int samples, F step) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < samples; i++) {
+		step();
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / samples;
+}
+
+// Saves a module's state as patch JSON text, as Rack writes it.
+inline std::string saveModule(Module *module) {
+	json_t *rootJ = module->toJson();
+	char *text = json_dumps(rootJ, JSON_COMPACT);
+	std::string s = text;
+	free(text);
+	json_decref(rootJ);
+	return s;
+}
+
+inline void loadModule(Module *module, const std::string &text) {
+	json_t *rootJ = json_loads(text.c_str(), 0, NULL);
+	module->fromJson(rootJ);
+	json_decref(rootJ);
+}
+
+// Logs a module's outputs, one line per sample on which any of them changed:
+// the sample number, then every output value.
+struct OutputTrace {
+	std::ostringstream text;
+	std::vector<float> last;
+
+	void record(uint64_t frame, const Module &module) {
+		bool changed = last.size() != module.outputs.size();
+		for (size_t i = 0; i < module.outputs.size() && !changed; i++) {
+			changed = module.outputs[i].value != last[i];
+		}
+		if (!changed) {
+			return;
+		}
+		last.resize(module.outputs.size());
+		text << frame << ":";
+		for (size_t i = 0; i < module.outputs.size(); i++) {
+			last[i] = module.outputs[i].value;
+			text << " " << last[i];
+		}
+		text << "\n";
+	}
+	std::string str() const {
+		return text.str();
+	}
+};
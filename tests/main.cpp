@@ -0,0 +1,76 @@
+#include "harness.hpp"
+
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static int failures = 0;
+
+std::vector<TestCase> &testCases() {
+	static std::vector<TestCase> cases;
+	return cases;
+}
+
+void fail(const char *file, int line, const std::string &message) {
+	fprintf(stderr, "%s:%d: check failed: %s\n", file, line, message.c_str());
+	failures++;
+}
+
+void checkGolden(const char *name, const std::string &trace) {
+	std::string path = std::string("golden/") + name + ".txt";
+	if (getenv("UPDATE_GOLDEN")) {
+		std::ofstream out(path.c_str());
+		out << trace;
+		fprintf(stderr, "wrote %s\n", path.c_str());
+		return;
+	}
+	std::ifstream in(path.c_str());
+	if (!in) {
+		fail(path.c_str(), 0, "missing golden trace, run with UPDATE_GOLDEN=1 to create it");
+		return;
+	}
+	std::istringstream actual(trace);
+	std::string expectedLine, actualLine;
+	for (int line = 1; ; line++) {
+		bool moreExpected = (bool) std::getline(in, expectedLine);
+		bool moreActual = (bool) std::getline(actual, actualLine);
+		if (!moreExpected && !moreActual) {
+			return;
+		}
+		if (!moreExpected || !moreActual || expectedLine != actualLine) {
+			fail(path.c_str(), line, "trace differs: expected \"" + (moreExpected ? expectedLine : "<end>")
+				+ "\", got \"" + (moreActual ? actualLine : "<end>") + "\"");
+			return;
+		}
+	}
+}
+
+void report(const char *name, double nsPerSample) {
+	report(name, nsPerSample, "ns/sample");
+}
+
+void report(const char *name, double value, const char *unit) {
+	printf("  bench %-36s %8.2f %s\n", name, value, unit);
+}
+
+// Runs every test, or those whose name contains the first argument.
+int main(int argc, char **argv) {
+	const char *filter = argc > 1 ? argv[1] : "";
+	int run = 0;
+	for (const TestCase &test : testCases()) {
+		if (!strstr(test.name, filter)) {
+			continue;
+		}
+		int before = failures;
+		fake::sampleRate() = 44100.0;
+		fake::seedRandom(1);
+		fake::dialogPath() = "";
+		test.run();
+		printf("%s %s\n", failures == before ? "ok  " : "FAIL", test.name);
+		run++;
+	}
+	printf("%d tests, %d failed checks\n", run, failures);
+	return failures ? 1 : 0;
+}
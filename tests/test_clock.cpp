@@ -0,0 +1,153 @@
+#include "harness.hpp"
+#include "Clock.hpp"
+
+
+// The clock InternalClock replaced: the phase is integrated on every sample,
+// and ticks when it crosses 1. The original accumulated in float, which
+// drifts by tens of samples per tick at slow tempos, so it only serves as a
+// benchmark; the tests compare with it accumulating in double.
+template <typename Phase>
+struct PhaseClock {
+	Phase phase = 0.0;
+
+	bool process(float voct, float multiplier, float sampleRate) {
+		phase += pow((Phase) 2.0, (Phase) voct) * multiplier / sampleRate;
+		if (phase >= 1.0) {
+			phase -= 1.0;
+			return true;
+		}
+		return false;
+	}
+	void reset() {
+		phase = 0.0;
+	}
+};
+
+// The same clock with an exact phase: a fixed-point fraction with 80 bits,
+// which holds any increment the clock knob and sample rates produce exactly.
+struct ExactClock {
+	typedef unsigned __int128 Fixed;
+	static const int BITS = 80;
+	Fixed phase = 0;
+	Fixed delta = 0;
+	float voct = INFINITY, multiplier = 0.0, sampleRate = 0.0;
+
+	bool process(float voct, float multiplier, float sampleRate) {
+		if (voct != this->voct || multiplier != this->multiplier || sampleRate != this->sampleRate) {
+			this->voct = voct;
+			this->multiplier = multiplier;
+			this->sampleRate = sampleRate;
+			double scaled = ldexp(exp2((double) voct) * multiplier / sampleRate, BITS);
+			assert(scaled == floor(scaled) && scaled < ldexp(1.0, 100));
+			delta = (Fixed) scaled;
+		}
+		phase += delta;
+		if (phase >= ((Fixed) 1 << BITS)) {
+			phase -= (Fixed) 1 << BITS;
+			return true;
+		}
+		return false;
+	}
+};
+
+// Clock settings from a given sample on
+struct ClockChange {
+	int64_t sample;
+	float voct;
+	float multiplier;
+	float sampleRate;
+};
+
+// Runs a clock through `changes`, and returns the samples it ticked on
+template <class TClock>
+static std::vector<int64_t> tickSamples(const std::vector<ClockChange> &changes, int64_t length) {
+	TClock clock;
+	std::vector<int64_t> ticks;
+	size_t next = 0;
+	ClockChange current = changes[0];
+	for (int64_t sample = 0; sample < length; sample++) {
+		if (next < changes.size() && changes[next].sample == sample) {
+			current = changes[next++];
+		}
+		if (clock.process(current.voct, current.multiplier, current.sampleRate)) {
+			ticks.push_back(sample);
+		}
+	}
+	return ticks;
+}
+
+// Largest distance in samples between the n-th ticks of `a` and `b`
+static int64_t maxDeviation(const std::vector<int64_t> &a, const std::vector<int64_t> &b) {
+	int64_t deviation = 0;
+	for (size_t i = 0; i < std::min(a.size(), b.size()); i++) {
+		deviation = std::max<int64_t>(deviation, llabs(a[i] - b[i]));
+	}
+	return deviation;
+}
+
+// Checks a clock against the exact per-sample clock. A tick whose exact phase
+// lands within rounding error of 1, which happens at tempos that divide the
+// sample rate, may fall on the sample either side; all others match, and
+// the error never accumulates.
+template <class TClock>
+static void checkTicks(const std::vector<ClockChange> &changes, int64_t length) {
+	std::vector<int64_t> expected = tickSamples<ExactClock>(changes, length);
+	std::vector<int64_t> actual = tickSamples<TClock>(changes, length);
+	CHECK(!expected.empty());
+	CHECK(llabs((int64_t) expected.size() - (int64_t) actual.size()) <= 1);
+	CHECK(maxDeviation(expected, actual) <= 1);
+}
+
+// Three minutes at a steady rate, for tempos across the clock knob's range
+// and the clock multipliers
+TEST(clock_steady_rates) {
+	static const float vocts[] = {-2.0, 0.0, 1.0, 2.0, 2.5, 3.321928, 5.0, 10.0};
+	static const float multipliers[] = {0.25, 1.0 / 3.0, 1.5, 12.0};
+	for (float voct : vocts) {
+		for (float multiplier : multipliers) {
+			std::vector<ClockChange> changes = {{0, voct, multiplier, 44100.0}};
+			checkTicks<InternalClock>(changes, 44100 * 180);
+			checkTicks<PhaseClock<double>>(changes, 44100 * 180);
+		}
+	}
+}
+
+// Tempo and sample rate changes land at arbitrary points within a period
+TEST(clock_rate_changes) {
+	static const float sampleRates[] = {44100.0, 48000.0, 96000.0, 22050.0, 192000.0};
+	std::vector<ClockChange> changes;
+	uint32_t state = 12345;
+	int64_t sample = 0;
+	for (int i = 0; i < 2000; i++) {
+		state = state * 1664525u + 1013904223u;
+		float voct = -1.0 + (state >> 8) % 6000 / 1000.0;
+		float sampleRate = sampleRates[(state >> 4) % 5];
+		changes.push_back({sample, voct, 1.0, sampleRate});
+		sample += 1 + (state >> 12) % 100000;
+	}
+	checkTicks<InternalClock>(changes, sample);
+	checkTicks<PhaseClock<double>>(changes, sample);
+}
+
+// A slow CV sweep moves the rate on every sample
+TEST(clock_cv_sweep) {
+	std::vector<ClockChange> changes;
+	const int64_t length = 44100 * 300;
+	for (int64_t sample = 0; sample < length; sample++) {
+		float voct = 2.0 + 2.0 * sinf(sample * 2.0 * M_PI / (44100 * 37));
+		changes.push_back({sample, voct, 1.0, 44100.0});
+	}
+	checkTicks<InternalClock>(changes, length);
+	checkTicks<PhaseClock<double>>(changes, length);
+}
+
+// Inputs are read through a volatile, as step() reads them from the params
+TEST(clock_bench) {
+	volatile float voct = 2.0;
+	int ticks = 0;
+	PhaseClock<float> phaseClock;
+	report("Per-sample phase clock", benchmark(4410000, [&]() { ticks += phaseClock.process(voct, 1.0, 44100.0); }));
+	InternalClock clock;
+	report("InternalClock", benchmark(4410000, [&]() { ticks += clock.process(voct, 1.0, 44100.0); }));
+	CHECK(ticks > 0);
+}
@@ -0,0 +1,139 @@
+#include "harness.hpp"
+#include "PatternCodec.hpp"
+
+
+// Compares the packed hex patterns with the JSON arrays of gates they
+// replaced, for GateSEQ8: 8 rows of 12 steps per pattern. Both sides save
+// the gates only, as compact JSON, and include the time to print or parse
+// the JSON.
+static const int STEPS = 12;
+static const int ROWS = 8;
+
+struct Gates {
+	uint32_t rows[ROWS];
+};
+
+static std::vector<Gates> randomPatterns(int count) {
+	std::vector<Gates> patterns(count);
+	for (Gates &p : patterns) {
+		for (int y = 0; y < ROWS; y++) {
+			p.rows[y] = randomu32() & ((1u << STEPS) - 1);
+		}
+	}
+	return patterns;
+}
+
+static std::string dumps(json_t *rootJ) {
+	char *text = json_dumps(rootJ, JSON_COMPACT);
+	std::string s = text;
+	free(text);
+	json_decref(rootJ);
+	return s;
+}
+
+static std::string encodeHex(const std::vector<Gates> &patterns) {
+	BitWriter writer;
+	for (const Gates &p : patterns) {
+		for (int y = 0; y < ROWS; y++) {
+			writer.write(p.rows[y], STEPS);
+		}
+	}
+	json_t *rootJ = json_object();
+	json_object_set_new(rootJ, "patternFormat", json_integer(1));
+	json_object_set_new(rootJ, "patternData", json_string(writer.finish().c_str()));
+	return dumps(rootJ);
+}
+
+static std::vector<Gates> decodeHex(const std::string &text, int count) {
+	std::vector<Gates> patterns(count);
+	json_t *rootJ = json_loads(text.c_str(), 0, NULL);
+	BitReader reader(json_string_value(json_object_get(rootJ, "patternData")));
+	for (Gates &p : patterns) {
+		for (int y = 0; y < ROWS; y++) {
+			reader.read(&p.rows[y], STEPS);
+		}
+	}
+	json_decref(rootJ);
+	return patterns;
+}
+
+// One integer per gate, row by row, as the "gates" array of older patches;
+// a bank is an array of those
+static std::string encodeArrays(const std::vector<Gates> &patterns) {
+	json_t *patternsJ = json_array();
+	for (const Gates &p : patterns) {
+		json_t *gatesJ = json_array();
+		for (int i = 0; i < ROWS * STEPS; i++) {
+			json_array_append_new(gatesJ, json_integer((p.rows[i / STEPS] >> (i % STEPS)) & 1));
+		}
+		json_array_append_new(patternsJ, gatesJ);
+	}
+	json_t *rootJ = json_object();
+	json_object_set_new(rootJ, "gates", patternsJ);
+	return dumps(rootJ);
+}
+
+static std::vector<Gates> decodeArrays(const std::string &text, int count) {
+	std::vector<Gates> patterns(count);
+	json_t *rootJ = json_loads(text.c_str(), 0, NULL);
+	json_t *patternsJ = json_object_get(rootJ, "gates");
+	for (int j = 0; j < count; j++) {
+		json_t *gatesJ = json_array_get(patternsJ, j);
+		Gates &p = patterns[j];
+		for (int y = 0; y < ROWS; y++) {
+			p.rows[y] = 0;
+		}
+		for (int i = 0; i < ROWS * STEPS; i++) {
+			p.rows[i / STEPS] |= (uint32_t) !!json_integer_value(json_array_get(gatesJ, i)) << (i % STEPS);
+		}
+	}
+	json_decref(rootJ);
+	return patterns;
+}
+
+static bool equal(const std::vector<Gates> &a, const std::vector<Gates> &b) {
+	return a.size() == b.size() && !memcmp(a.data(), b.data(), a.size() * sizeof(Gates));
+}
+
+TEST(codec_round_trip) {
+	for (int count : {1, 3, 64}) {
+		std::vector<Gates> patterns = randomPatterns(count);
+		CHECK(equal(decodeHex(encodeHex(patterns), count), patterns));
+		CHECK(equal(decodeArrays(encodeArrays(patterns), count), patterns));
+	}
+}
+
+// Reads stop at the end of the data, and at characters that are not hex
+TEST(codec_short_data) {
+	BitReader reader("a5");
+	uint32_t value = 0;
+	CHECK(reader.read(&value, 6));
+	CHECK_EQ(value, (uint32_t) 0x1a);
+	CHECK(!reader.read(&value, 3));
+	BitReader invalid("1x");
+	CHECK(invalid.read(&value, 4));
+	CHECK(!invalid.read(&value, 1));
+}
+
+template <typename F>
+static double microseconds(int iterations, F f) {
+	return benchmark(iterations, f) / 1000.0;
+}
+
+TEST(codec_bench) {
+	for (int count : {1, 64}) {
+		std::vector<Gates> patterns = randomPatterns(count);
+		std::string hex = encodeHex(patterns);
+		std::string arrays = encodeArrays(patterns);
+		int iterations = 64000 / count;
+		const char *label = count == 1 ? "1 pattern" : "64 patterns";
+		size_t sink = 0;
+		report(stringf("%s, hex size", label).c_str(), hex.size(), "bytes");
+		report(stringf("%s, arrays size", label).c_str(), arrays.size(), "bytes");
+		report(stringf("%s, hex encode", label).c_str(), microseconds(iterations, [&]() { sink += encodeHex(patterns).size(); }), "us");
+		report(stringf("%s, arrays encode", label).c_str(), microseconds(iterations, [&]() { sink += encodeArrays(patterns).size(); }), "us");
+		report(stringf("%s, hex decode", label).c_str(), microseconds(iterations, [&]() { sink += decodeHex(hex, count)[0].rows[0]; }), "us");
+		report(stringf("%s, arrays decode", label).c_str(), microseconds(iterations, [&]() { sink += decodeArrays(arrays, count)[0].rows[0]; }), "us");
+		CHECK(sink > 0);
+	}
+}
@@ -0,0 +1,334 @@
+#include "harness.hpp"
+#include "../src/GateSeq8.cpp"
+
+
+typedef GateSEQ<12, 8> GateSEQ8;
+typedef GateSEQ<16, 8> GateSEQ16;
+typedef GateSEQ<32, 4> GateSEQ32;
+
+// Patterns are written from the "UI thread" and picked up by the next step()
+template <int Steps, int Channels>
+static void writePattern(GateSEQ<Steps, Channels> *module, int slot, const Pattern<Steps, Channels> &p) {
+	module->bank.lock();
+	module->bank.write(slot, p);
+	module->bank.unlock();
+}
+
+// A pattern with steady, alternating and sparse rows, a 50% step, and ratchets
+static Pattern<12, 8> testPattern() {
+	Pattern<12, 8> p = {};
+	p.rows[0] = 0xfff;
+	p.rows[1] = 0x555;
+	p.rows[2] = 0x249;
+	p.steps[2].skip = 128;
+	p.steps[4].ratchets = 2;
+	p.steps[7].skip = 64;
+	p.steps[7].ratchets = 1;
+	return p;
+}
+
+TEST(gateseq8_golden) {
+	GateSEQ8Widget widget;
+	GateSEQ8 *module = dynamic_cast<GateSEQ8*>(widget.module);
+	writePattern(module, 0, testPattern());
+	Pattern<12, 8> second = {};
+	second.rows[0] = 0x00f;
+	second.rows[3] = 0xf00;
+	writePattern(module, 1, second);
+	module->params[GateSEQ8::HITS1_PARAM + 7].value = 5.0;
+
+	OutputTrace trace;
+	const int rate = 44100;
+	for (int frame = 0; frame < 3 * rate; frame++) {
+		if (frame == rate) {
+			module->inputs[GateSEQ8::PATTERN_INPUT].value = 0.16;
+		}
+		module->inputs[GateSEQ8::RESET_INPUT].value = (frame == rate * 3 / 2) ? 10.0 : 0.0;
+		if (frame == 2 * rate) {
+			module->inputs[GateSEQ8::PATTERN_INPUT].value = 0.0;
+			module->inputs[GateSEQ8::CLOCK_INPUT].value = 1.0;
+			module->inputs[GateSEQ8::HITS_INPUT].value = -2.0;
+			module->inputs[GateSEQ8::ROTATE_INPUT].value = 1.0;
+		}
+		if (frame >= rate * 5 / 2) {
+			module->inputs[GateSEQ8::EXT_CLOCK_INPUT].active = true;
+			module->inputs[GateSEQ8::EXT_CLOCK_INPUT].value = (frame % 3000 < 100) ? 10.0 : 0.0;
+		}
+		module->params[GateSEQ8::RUN_PARAM].value = (frame == rate * 29 / 10) ? 1.0 : 0.0;
+		module->step();
+		trace.record(frame, *module);
+	}
+	checkGolden("gateseq8", trace.str());
+}
+
+// Two GateSEQ16s chained in steps mode play as one 3 + 5 step pattern
+TEST(gateseq16_chain_golden) {
+	GateSEQ16Widget leftWidget, rightWidget;
+	GateSEQ16 *left = dynamic_cast<GateSEQ16*>(leftWidget.module);
+	GateSEQ16 *right = dynamic_cast<GateSEQ16*>(rightWidget.module);
+	left->params[GateSEQ16::STEPS_PARAM].value = 3.0;
+	right->params[GateSEQ16::STEPS_PARAM].value = 5.0;
+	Pattern<16, 8> p = {};
+	p.rows[0] = 0xffff;
+	p.rows[1] = 0x5;
+	writePattern(left, 0, p);
+	p.rows[1] = 0x12;
+	writePattern(right, 0, p);
+
+	left->chainMode = CHAIN_STEPS;
+	right->chainPrev = left;
+	right->chained = true;
+	left->chainNext = right;
+
+	OutputTrace leftTrace, rightTrace;
+	for (int frame = 0; frame < 2 * 44100; frame++) {
+		left->step();
+		right->step();
+		leftTrace.record(frame, *left);
+		rightTrace.record(frame, *right);
+	}
+	left->chainNext = NULL;
+	right->chainPrev = NULL;
+	right->chained = false;
+	checkGolden("gateseq16_chain", "left\n" + leftTrace.str() + "right\n" + rightTrace.str());
+}
+
+// A chain unlinked after the left module stepped it, but before the right
+// module's own step() in the same sample, plays the right module only once
+TEST(gateseq_chain_unlink_mid_sample) {
+	GateSEQ16Widget leftWidget, rightWidget;
+	GateSEQ16 *left = dynamic_cast<GateSEQ16*>(leftWidget.module);
+	GateSEQ16 *right = dynamic_cast<GateSEQ16*>(rightWidget.module);
+	right->chainPrev = left;
+	right->chained = true;
+	left->chainNext = right;
+	for (int frame = 0; frame < 1000; frame++) {
+		left->step();
+		right->step();
+	}
+
+	uint64_t samples = right->stats.samples;
+	left->step();
+	CHECK_EQ(right->stats.samples, samples + 1);
+	left->chainNext = NULL;
+	right->chainPrev = NULL;
+	right->chained = false;
+	right->step();
+	CHECK_EQ(right->stats.samples, samples + 1);
+	left->step();
+	right->step();
+	CHECK_EQ(right->stats.samples, samples + 2);
+}
+
+// Synced modules play in lockstep, whatever order the engine steps them in.
+// The first module in the step order syncs after the second has taken the
+// lead, so it steps before the lead on every sample; a third is added later,
+// and steps after both. The lead's clock rate changes as they play.
+TEST(gateseq_sync_step_order) {
+	GateSEQ8Widget firstWidget, leadWidget;
+	GateSEQ8 *first = dynamic_cast<GateSEQ8*>(firstWidget.module);
+	GateSEQ8 *lead = dynamic_cast<GateSEQ8*>(leadWidget.module);
+	GateSEQ8Widget *lateWidget = NULL;
+	GateSEQ8 *late = NULL;
+	// Without probability steps, which each module rolls with its own seed
+	Pattern<12, 8> p = testPattern();
+	p.steps[2].skip = p.steps[7].skip = 0;
+	for (GateSEQ8 *module : {first, lead}) {
+		writePattern(module, 0, p);
+	}
+	lead->synced = true;
+
+	const int rate = 44100;
+	int differing = 0;
+	for (int frame = 0; frame < 3 * rate; frame++) {
+		if (frame == rate / 10) {
+			first->synced = true;
+		}
+		if (frame == rate / 2) {
+			lateWidget = new GateSEQ8Widget();
+			late = dynamic_cast<GateSEQ8*>(lateWidget->module);
+			writePattern(late, 0, p);
+			late->synced = true;
+		}
+		// Reset all of them together, so they play the same step
+		bool reset = (frame == rate * 6 / 10);
+		lead->inputs[GateSEQ8::CLOCK_INPUT].value = (frame < rate * 3 / 2) ? 0.5 : (frame < 2 * rate) ? 1.3 : -0.7;
+		for (GateSEQ8 *module : {first, lead, late}) {
+			if (module) {
+				module->inputs[GateSEQ8::RESET_INPUT].value = reset ? 10.0 : 0.0;
+				module->step();
+			}
+		}
+		if (frame > rate * 6 / 10) {
+			for (size_t i = 0; i < lead->outputs.size(); i++) {
+				differing += first->outputs[i].value != lead->outputs[i].value;
+				differing += late->outputs[i].value != lead->outputs[i].value;
+			}
+		}
+	}
+	CHECK_EQ(differing, 0);
+	CHECK(gClockDomain.lead.load() == lead);
+	delete lateWidget;
+}
+
+// At a slow tempo the step lights fade before a ratcheted step ends; the
+// last ratcheted gate still opens and holds until the next step
+TEST(gateseq_slow_ratchets) {
+	GateSEQ8Widget widget;
+	GateSEQ8 *module = dynamic_cast<GateSEQ8*>(widget.module);
+	Pattern<12, 8> p = {};
+	p.rows[0] = 0xfff;
+	for (int x = 0; x < 12; x++) {
+		p.steps[x].ratchets = 1;
+	}
+	writePattern(module, 0, p);
+	module->params[GateSEQ8::CLOCK_PARAM].value = -2.0;
+
+	// Four 4 s steps; each but the first has a closed half
+	const int stepLength = 4 * 44100;
+	int lowRun = 0, longestLowRun = 0, lowSamples = 0;
+	for (int frame = 0; frame < 4 * stepLength; frame++) {
+		module->step();
+		bool low = module->outputs[GateSEQ8::GATE1_OUTPUT].value == 0.0;
+		lowRun = low ? lowRun + 1 : 0;
+		lowSamples += low;
+		longestLowRun = std::max(longestLowRun, lowRun);
+	}
+	CHECK(longestLowRun <= stepLength / 4 + 2);
+	CHECK(lowSamples >= 2 * (stepLength / 4));
+	CHECK(module->stats.idleSamples > 0);
+}
+
+// Generated rows follow their params and inputs, and are written again when
+// an edit overwrites them or the pattern changes, before the pattern plays
+TEST(gateseq_generated_rows) {
+	GateSEQ8Widget widget;
+	GateSEQ8 *module = dynamic_cast<GateSEQ8*>(widget.module);
+	module->params[GateSEQ8::HITS1_PARAM].value = 3.0;
+	module->step();
+	CHECK_EQ(module->bank.patterns[0].rows[0], euclid(12, 3, 0));
+
+	module->inputs[GateSEQ8::ROTATE_INPUT].value = 2.0;
+	module->step();
+	CHECK_EQ(module->bank.patterns[0].rows[0], euclid(12, 3, 2));
+
+	writePattern(module, 0, Pattern<12, 8>());
+	module->step();
+	CHECK_EQ(module->bank.patterns[0].rows[0], euclid(12, 3, 2));
+
+	module->pattern = 5;
+	module->step();
+	CHECK_EQ(module->bank.patterns[5].rows[0], euclid(12, 3, 2));
+
+	// A pattern switched to by CV plays its generated row from the first
+	// sample, never the mask stored in the slot before the switch
+	Pattern<12, 8> full = {};
+	full.rows[0] = 0xfff;
+	writePattern(module, 6, full);
+	uint32_t row = euclid(12, 3, 2);
+	int stale = 0;
+	for (int frame = 0; frame < 44100; frame++) {
+		if (frame == 10000) {
+			module->inputs[GateSEQ8::PATTERN_INPUT].value = 0.94;
+		}
+		module->step();
+		bool high = module->outputs[GateSEQ8::GATE1_OUTPUT].value > 5.0;
+		stale += high && !((row >> module->index) & 1);
+	}
+	CHECK_EQ(module->pattern, 6);
+	CHECK_EQ(stale, 0);
+}
+
+// While the UI thread holds the bank's lock, generated rows wait for it
+// rather than changing a pattern the UI may be reading
+TEST(gateseq_generated_rows_locked) {
+	GateSEQ8Widget widget;
+	GateSEQ8 *module = dynamic_cast<GateSEQ8*>(widget.module);
+	module->bank.lock();
+	module->params[GateSEQ8::HITS1_PARAM].value = 3.0;
+	module->step();
+	CHECK_EQ(module->bank.patterns[0].rows[0], 0u);
+	module->bank.unlock();
+	module->step();
+	CHECK_EQ(module->bank.patterns[0].rows[0], euclid(12, 3, 0));
+}
+
+// Randomizing draws new gates, and keeps the ratchets and probabilities
+TEST(gateseq_randomize_keeps_steps) {
+	GateSEQ8Widget widget;
+	GateSEQ8 *module = dynamic_cast<GateSEQ8*>(widget.module);
+	Pattern<12, 8> p = testPattern();
+	writePattern(module, 0, p);
+	module->randomize();
+	module->step();
+	const Pattern<12, 8> &randomized = module->bank.patterns[0];
+	int changedRows = 0;
+	for (int y = 0; y < 8; y++) {
+		changedRows += randomized.rows[y] != p.rows[y];
+	}
+	CHECK(changedRows > 0);
+	CHECK(!memcmp(randomized.steps, p.steps, sizeof(p.steps)));
+}
+
+// Patterns and step settings survive a save and reload
+TEST(gateseq_save_load) {
+	GateSEQ32Widget widget, reloadedWidget;
+	GateSEQ32 *module = dynamic_cast<GateSEQ32*>(widget.module);
+	GateSEQ32 *reloaded = dynamic_cast<GateSEQ32*>(reloadedWidget.module);
+	for (int i = 0; i < NUM_PATTERNS; i += 5) {
+		Pattern<32, 4> p = {};
+		for (int y = 0; y < 4; y++) {
+			p.rows[y] = randomu32();
+		}
+		p.steps[i % 32].skip = i;
+		p.steps[31 - i % 32].ratchets = i % 4;
+		writePattern(module, i, p);
+	}
+	module->multiplier = 2;
+	module->synced = true;
+	loadModule(reloaded, saveModule(module));
+	CHECK_EQ(reloaded->multiplier, 2);
+	CHECK(reloaded->synced);
+	CHECK_EQ(reloaded->random.seed, module->random.seed);
+	for (int i = 0; i < NUM_PATTERNS; i++) {
+		CHECK(!memcmp(&reloaded->bank.read(i), &module->bank.read(i), sizeof(Pattern<32, 4>)));
+	}
+}
+
+// Patches from before pattern banks hold one pattern as an array of gates
+TEST(gateseq_load_gates_array) {
+	GateSEQ8Widget widget;
+	GateSEQ8 *module = dynamic_cast<GateSEQ8*>(widget.module);
+	std::string gates;
+	for (int i = 0; i < 12 * 8; i++) {
+		gates += (i ? "," : "") + std::string((i % 5 == 0) ? "1" : "0");
+	}
+	loadModule(module, "{\"multiplier\": 0.3, \"gates\": [" + gates + "]}");
+	CHECK_EQ(clockMultipliers[module->multiplier].num, 1);
+	CHECK_EQ(clockMultipliers[module->multiplier].den, 3);
+	const Pattern<12, 8> &p = module->bank.read(0);
+	for (int i = 0; i < 12 * 8; i++) {
+		CHECK_EQ(p.get(i / 12, i % 12), i % 5 == 0);
+	}
+	CHECK(module->bank.read(1).empty());
+}
+
+TEST(gateseq_bench) {
+	GateSEQ8Widget widget8;
+	GateSEQ8 *module8 = dynamic_cast<GateSEQ8*>(widget8.module);
+	writePattern(module8, 0, testPattern());
+	module8->step();
+	report("GateSEQ8, internal clock", benchmark(441000, [&]() { module8->step(); }));
+
+	GateSEQ32Widget widget32;
+	GateSEQ32 *module32 = dynamic_cast<GateSEQ32*>(widget32.module);
+	Pattern<32, 4> p = {};
+	p.rows[0] = 0x55555555;
+	writePattern(module32, 0, p);
+	module32->inputs[GateSEQ32::EXT_CLOCK_INPUT].active = true;
+	int frame = 0;
+	report("GateSEQ32, external clock", benchmark(441000, [&]() {
+		module32->inputs[GateSEQ32::EXT_CLOCK_INPUT].value = (frame++ % 100 < 50) ? 10.0 : 0.0;
+		module32->step();
+	}));
+}
@@ -0,0 +1,205 @@
+#include "harness.hpp"
+#include "../src/Player.cpp"
+
+#include <unistd.h>
+
+
+// The fixture's frame i holds i * 16 on the left channel, as 16-bit samples
+static float rampValue(int64_t frame) {
+	return frame * 16 / 32768.0 * 5.0;
+}
+
+// Waits until the prefetch thread has handled every seek and has the next
+// frame ready, so that what the engine plays doesn't depend on thread timing.
+template <unsigned int ChannelCount>
+static bool waitForPrefetch(Player<ChannelCount> *player) {
+	for (int i = 0; i < 5000; i++) {
+		uint64_t start = std::max(player->readPos.load(), player->flushStart.load());
+		if (player->isLoaded && player->seekDone.load() == player->seeks
+				&& (player->writePos.load() > start || player->atEnd)) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+// Seeks to `position` volts, 0-10V spanning the file
+template <unsigned int ChannelCount>
+static void seek(Player<ChannelCount> *player, float position) {
+	player->inputs[Player<ChannelCount>::POSITION_INPUT].value = position;
+	player->inputs[Player<ChannelCount>::SEEK_INPUT].value = 10.0;
+	player->step();
+	player->inputs[Player<ChannelCount>::SEEK_INPUT].value = 0.0;
+}
+
+// Loads a file and steps once, so the triggers have seen a low input
+template <unsigned int ChannelCount>
+static bool load(Player<ChannelCount> *player, std::string path) {
+	player->load(path);
+	bool ready = waitForPrefetch(player);
+	player->step();
+	return ready;
+}
+
+template <unsigned int ChannelCount>
+static void pressPlay(Player<ChannelCount> *player) {
+	player->inputs[Player<ChannelCount>::PLAY_INPUT].value = 10.0;
+	player->step();
+	player->inputs[Player<ChannelCount>::PLAY_INPUT].value = 0.0;
+}
+
+// Plays 300 frames, pauses, seeks to the middle, and plays to the end
+TEST(player_golden) {
+	Player2Widget widget;
+	Player<2> *module = dynamic_cast<Player<2>*>(widget.module);
+	CHECK(load(module, "fixtures/stereo16.wav"));
+
+	OutputTrace trace;
+	int frame = 0;
+	pressPlay(module);
+	trace.record(frame++, *module);
+	for (; frame < 300; frame++) {
+		module->step();
+		trace.record(frame, *module);
+	}
+	pressPlay(module);
+	trace.record(frame++, *module);
+	seek(module, 5.0);
+	trace.record(frame++, *module);
+	CHECK(waitForPrefetch(module));
+	pressPlay(module);
+	trace.record(frame++, *module);
+	for (; frame < 900; frame++) {
+		module->step();
+		trace.record(frame, *module);
+	}
+	checkGolden("player", trace.str());
+	CHECK(!module->isPlaying);
+	CHECK_EQ(module->underruns.load(), (uint64_t) 0);
+}
+
+// Seeks while playing: the first frame played after each seek is the target
+TEST(player_seek) {
+	Player2Widget widget;
+	Player<2> *module = dynamic_cast<Player<2>*>(widget.module);
+	CHECK(load(module, "fixtures/stereo16.wav"));
+	pressPlay(module);
+
+	for (int i = 0; i < 500; i++) {
+		float position = 0.1 + (i * 37 % 800) / 100.0;
+		int64_t target = (int64_t) ((double) clampf(position / 10.0, 0.0, 1.0) * module->numFrames);
+		seek(module, position);
+		int silent = 0;
+		while (module->outputs[0].value == 0.0 && silent++ < 1000000) {
+			std::this_thread::yield();
+			module->step();
+		}
+		CHECK_EQ(module->outputs[0].value, rampValue(target));
+		for (int j = 0; j < 10; j++) {
+			module->step();
+		}
+		CHECK_EQ(module->outputs[0].value, rampValue(target + 10));
+	}
+}
+
+// Seek targets past 2^24 frames land on the exact frame
+TEST(player_seek_long_file) {
+	Player2Widget widget;
+	Player<2> *module = dynamic_cast<Player<2>*>(widget.module);
+	module->numFrames = 100000007;
+	module->step();
+	seek(module, 5.0);
+	CHECK_EQ(module->seekTarget.load(), (int64_t) 50000003);
+	module->step();
+	seek(module, 10.0);
+	CHECK_EQ(module->seekTarget.load(), (int64_t) 100000007);
+}
+
+// The ring only exists while a file is loaded, and the engine plays silence
+// without it
+TEST(player_ring_lifetime) {
+	Player8Widget widget;
+	Player<8> *module = dynamic_cast<Player<8>*>(widget.module);
+	CHECK(module->ring == NULL);
+	CHECK(sizeof(Player<8>) < 4096);
+	pressPlay(module);
+	module->step();
+	CHECK_EQ(module->outputs[0].value, 0.0f);
+
+	CHECK(load(module, "fixtures/stereo16.wav"));
+	CHECK(module->ring != NULL);
+	CHECK_EQ(module->memory.size >= sizeof(float) * RINGSIZE * 8, true);
+	module->unload();
+	CHECK(module->ring == NULL);
+	CHECK_EQ(module->memory.size, (size_t) 0);
+	module->step();
+	CHECK_EQ(module->outputs[0].value, 0.0f);
+}
+
+// The context menu shows the underruns since the file was loaded
+TEST(player_underruns_menu) {
+	Player2Widget widget;
+	Player<2> *module = dynamic_cast<Player<2>*>(widget.module);
+	module->underruns = 7;
+	CHECK(load(module, "fixtures/stereo16.wav"));
+	module->underruns = module->underruns + 3;
+	Menu *menu = widget.createContextMenu();
+	int found = 0;
+	for (Widget *child : menu->children) {
+		MenuLabel *label = dynamic_cast<MenuLabel*>(child);
+		found += label && label->text == "Underruns: 3 frames";
+	}
+	CHECK_EQ(found, 1);
+	gScene->removeChild(menu);
+	delete menu;
+}
+
+// Ten seconds of stereo, written to a temporary file
+static std::string writeLongFile() {
+	char path[] = "/tmp/dekstop_player_XXXXXX";
+	int fd = mkstemp(path);
+	close(fd);
+	WAV_Writer writer;
+	Audio_WAV_OpenWriter(&writer, path, 44100, 2);
+	short block[2 * 441];
+	for (int i = 0; i < 2 * 441; i++) {
+		block[i] = i * 37;
+	}
+	for (int i = 0; i < 1000; i++) {
+		Audio_WAV_WriteShorts(&writer, block, 2 * 441);
+	}
+	Audio_WAV_CloseWriter(&writer);
+	return path;
+}
+
+// Benchmarks play from a full ring, so they don't wait on the disk
+static const int BENCH_FRAMES = RINGSIZE - CHUNKSIZE;
+
+template <unsigned int ChannelCount>
+static void waitForFill(Player<ChannelCount> *player) {
+	while (player->writePos.load() < (uint64_t) BENCH_FRAMES) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+TEST(player_bench) {
+	std::string path = writeLongFile();
+	{
+		Player2Widget widget;
+		Player<2> *module = dynamic_cast<Player<2>*>(widget.module);
+		load(module, path);
+		waitForFill(module);
+		pressPlay(module);
+		report("Player2, playing", benchmark(BENCH_FRAMES, [&]() { module->step(); }));
+	}
+	{
+		Player8Widget widget;
+		Player<8> *module = dynamic_cast<Player<8>*>(widget.module);
+		load(module, path);
+		waitForFill(module);
+		pressPlay(module);
+		report("Player8, playing a stereo file", benchmark(BENCH_FRAMES, [&]() { module->step(); }));
+	}
+	unlink(path.c_str());
+}
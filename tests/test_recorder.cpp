@@ -0,0 +1,118 @@
+#include "harness.hpp"
+#include "../src/Recorder.cpp"
+#include "read_wav.h"
+
+#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Records input 1 as audio and input 2 as a gate, with the same irregular
+// square wave on both, then checks that every line of the gates CSV names
+// the frame of the main file where the audio changes with it.
+TEST(recorder_gate_frames) {
+	char dir[] = "/tmp/dekstop_recorder_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string path = std::string(dir) + "/take.wav";
+	std::string gatesPath = std::string(dir) + "/take.gates.csv";
+	fake::dialogPath() = path;
+
+	Recorder2Widget widget;
+	Recorder<2> *module = dynamic_cast<Recorder<2>*>(widget.module);
+	module->captureModes[1] = CAPTURE_GATE;
+	module->lossless = true;
+	// Frames before the recording starts, so engine frames and file frames
+	// differ
+	for (int i = 0; i < 1000; i++) {
+		module->step();
+	}
+	module->pressRecord();
+	CHECK(module->isRecording);
+
+	const int length = 100000;
+	int edges = 0;
+	bool high = false;
+	for (int frame = 0; frame < length; frame++) {
+		bool next = (frame / 1000 + frame / 777) % 2;
+		edges += next != high;
+		high = next;
+		for (int i = 0; i < 2; i++) {
+			module->inputs[Recorder<2>::AUDIO1_INPUT + i].value = high ? 10.0 : 0.0;
+		}
+		module->step();
+	}
+	CHECK(module->startedAt.load() > 0);
+	module->pressRecord();
+	CHECK(!module->isRecording);
+
+	WAV_Reader reader;
+	CHECK_EQ(Audio_WAV_OpenReader(&reader, path.c_str()), 0L);
+	CHECK_EQ(reader.numFrames, (long long) length);
+	std::vector<float> audio(length);
+	Audio_WAV_ReadFloats(&reader, 0, length, audio.data(), 1);
+	Audio_WAV_CloseReader(&reader);
+
+	std::ifstream gates(gatesPath.c_str());
+	std::string line;
+	int lines = 0, mismatched = 0;
+	while (std::getline(gates, line)) {
+		unsigned long long frame;
+		unsigned input;
+		int gate;
+		if (sscanf(line.c_str(), "%llu,%u,%d", &frame, &input, &gate) != 3) {
+			continue;
+		}
+		lines++;
+		bool matches = input == 2 && frame < (unsigned long long) length
+			&& (audio[frame] > 0.5) == (gate != 0)
+			&& (frame == 0 || (audio[frame - 1] > 0.5) != (gate != 0));
+		mismatched += !matches;
+	}
+	CHECK_EQ(lines, edges);
+	CHECK_EQ(mismatched, 0);
+
+	unlink(path.c_str());
+	unlink(gatesPath.c_str());
+	rmdir(dir);
+}
+
+// Frames still in the ring when recording stops reach the stream reader,
+// and aren't reported as discarded
+TEST(recorder_stream_tail) {
+	char dir[] = "/tmp/dekstop_recorder_XXXXXX";
+	CHECK(mkdtemp(dir));
+	std::string path = std::string(dir) + "/stream";
+	CHECK_EQ(mkfifo(path.c_str(), 0600), 0);
+	int reader = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+	CHECK(reader >= 0);
+	fake::dialogPath() = path;
+
+	Recorder2Widget widget;
+	Recorder<2> *module = dynamic_cast<Recorder<2>*>(widget.module);
+	module->streamMode = true;
+	module->pressRecord();
+	CHECK(module->isRecording);
+	// Few enough frames to fit in the pipe, and to still be in the ring when
+	// the recording stops
+	const int length = 4000;
+	for (int frame = 0; frame < length; frame++) {
+		module->inputs[Recorder<2>::AUDIO1_INPUT].value = 1.0;
+		module->step();
+	}
+	module->pressRecord();
+	CHECK(!module->isRecording);
+	CHECK_EQ(module->discardedFrames, (uint64_t) 0);
+
+	char data[65536];
+	size_t total = 0;
+	ssize_t n;
+	while ((n = read(reader, data, sizeof(data))) > 0) {
+		total += n;
+	}
+	CHECK_EQ(total, (size_t) (44 + length * 2 * 2));
+
+	close(reader);
+	unlink(path.c_str());
+	rmdir(dir);
+}
@@ -0,0 +1,93 @@
+#include "harness.hpp"
+#include "../src/TriSEQ3.cpp"
+
+
+// Gates on five of eight steps, a row switch pattern, a 50% step and ratchets
+static void setUpTriSEQ3(TriSEQ3 *module) {
+	static const bool gates[8] = {true, false, true, true, false, true, false, true};
+	for (int i = 0; i < 8; i++) {
+		module->gateState[i] = gates[i];
+		module->params[TriSEQ3::ROW1_PARAM + i].value = i % 3;
+		module->params[TriSEQ3::ROW2_PARAM + i].value = (i + 1) % 3;
+		module->params[TriSEQ3::ROW3_PARAM + i].value = (i / 3) % 3;
+	}
+	module->steps[2].skip = 128;
+	module->steps[5].ratchets = 3;
+	module->edited = true;
+}
+
+TEST(triseq3_golden) {
+	TriSEQ3Widget widget;
+	TriSEQ3 *module = dynamic_cast<TriSEQ3*>(widget.module);
+	setUpTriSEQ3(module);
+
+	OutputTrace trace;
+	const int rate = 44100;
+	for (int frame = 0; frame < 3 * rate; frame++) {
+		module->inputs[TriSEQ3::RESET_INPUT].value = (frame == rate * 6 / 5) ? 10.0 : 0.0;
+		if (frame == 2 * rate) {
+			module->inputs[TriSEQ3::STEPS_INPUT].value = -3.0;
+			module->inputs[TriSEQ3::CLOCK_INPUT].value = 0.5;
+		}
+		if (frame == rate * 9 / 4) {
+			// Flip a row switch under the playhead's path
+			module->params[TriSEQ3::ROW1_PARAM + 1].value = 2.0;
+		}
+		if (frame >= rate * 5 / 2) {
+			module->inputs[TriSEQ3::EXT_CLOCK_INPUT].active = true;
+			module->inputs[TriSEQ3::EXT_CLOCK_INPUT].value = (frame % 2205 < 100) ? 10.0 : 0.0;
+		}
+		module->step();
+		trace.record(frame, *module);
+	}
+	checkGolden("triseq3", trace.str());
+}
+
+// At a slow tempo the step lights fade before a ratcheted step ends; the
+// last ratcheted gate still opens and holds until the next step
+TEST(triseq3_slow_ratchets) {
+	TriSEQ3Widget widget;
+	TriSEQ3 *module = dynamic_cast<TriSEQ3*>(widget.module);
+	for (int i = 0; i < 8; i++) {
+		module->gateState[i] = true;
+		module->steps[i].ratchets = 1;
+	}
+	module->edited = true;
+	module->params[TriSEQ3::CLOCK_PARAM].value = -2.0;
+
+	// Four 4 s steps; each but the first has a closed half
+	const int stepLength = 4 * 44100;
+	int lowRun = 0, longestLowRun = 0, lowSamples = 0;
+	for (int frame = 0; frame < 4 * stepLength; frame++) {
+		module->step();
+		bool low = module->outputs[TriSEQ3::GATES_OUTPUT].value == 0.0;
+		lowRun = low ? lowRun + 1 : 0;
+		lowSamples += low;
+		longestLowRun = std::max(longestLowRun, lowRun);
+	}
+	CHECK(longestLowRun <= stepLength / 4 + 2);
+	CHECK(lowSamples >= 2 * (stepLength / 4));
+	CHECK(module->stats.idleSamples > 0);
+}
+
+TEST(triseq3_save_load) {
+	TriSEQ3Widget widget, reloadedWidget;
+	TriSEQ3 *module = dynamic_cast<TriSEQ3*>(widget.module);
+	TriSEQ3 *reloaded = dynamic_cast<TriSEQ3*>(reloadedWidget.module);
+	setUpTriSEQ3(module);
+	loadModule(reloaded, saveModule(module));
+	CHECK_EQ(reloaded->random.seed, module->random.seed);
+	for (int i = 0; i < 8; i++) {
+		CHECK_EQ(reloaded->gateState[i], module->gateState[i]);
+		CHECK_EQ(reloaded->steps[i].skip, module->steps[i].skip);
+		CHECK_EQ(reloaded->steps[i].ratchets, module->steps[i].ratchets);
+	}
+}
+
+TEST(triseq3_bench) {
+	TriSEQ3Widget widget;
+	TriSEQ3 *module = dynamic_cast<TriSEQ3*>(widget.module);
+	setUpTriSEQ3(module);
+	module->step();
+	report("TriSEQ3, internal clock", benchmark(441000, [&]() { module->step(); }));
+}
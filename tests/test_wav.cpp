@@ -0,0 +1,114 @@
+#include "harness.hpp"
+#include "read_wav.h"
+
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+
+// The fixtures are written by fixtures/make_fixtures.py. Their frames are a
+// ramp: frame i holds i * 16 on the first channel, and its negation on the
+// second.
+static float rampSample(long long frame, int channel) {
+	return (channel ? -frame : frame) * 16 / 32768.0f;
+}
+
+// Converts every frame, and checks each against the ramp
+static void checkRamp(const WAV_Reader &reader) {
+	std::vector<float> samples(reader.numFrames * 2 + 2);
+	CHECK_EQ(Audio_WAV_ReadFloats(&reader, 0, reader.numFrames + 1, samples.data(), 2), (long) reader.numFrames);
+	int errors = 0;
+	for (long long i = 0; i < reader.numFrames; i++) {
+		errors += samples[i * 2] != rampSample(i, 0);
+		errors += samples[i * 2 + 1] != (reader.samplesPerFrame > 1 ? rampSample(i, 1) : 0.0f);
+	}
+	CHECK_EQ(errors, 0);
+	CHECK_EQ(Audio_WAV_ReadFloats(&reader, reader.numFrames, 1, samples.data(), 2), 0L);
+}
+
+TEST(wav_plain_riff) {
+	WAV_Reader reader;
+	CHECK_EQ(Audio_WAV_OpenReader(&reader, "fixtures/stereo16.wav"), 0L);
+	CHECK_EQ(reader.sampleType, WAV_SAMPLE_INT16);
+	CHECK_EQ(reader.samplesPerFrame, 2);
+	CHECK_EQ(reader.frameRate, 44100);
+	CHECK_EQ(reader.bytesPerFrame, 4);
+	CHECK_EQ(reader.numFrames, 1000LL);
+	CHECK(!reader.truncated);
+	CHECK_EQ(reader.timeReference, 0ULL);
+	checkRamp(reader);
+	Audio_WAV_CloseReader(&reader);
+}
+
+TEST(wav_rf64_ds64) {
+	WAV_Reader reader;
+	CHECK_EQ(Audio_WAV_OpenReader(&reader, "fixtures/rf64.wav"), 0L);
+	CHECK_EQ(reader.numFrames, 1000LL);
+	CHECK(!reader.truncated);
+	checkRamp(reader);
+	Audio_WAV_CloseReader(&reader);
+}
+
+// The data size of 0xFFFFFFFF refers to a ds64 chunk, which an RF64 file
+// has to have
+TEST(wav_rf64_without_ds64) {
+	std::ifstream in("fixtures/rf64.wav", std::ios::binary);
+	std::vector<unsigned char> image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	CHECK_EQ(image.size(), (size_t) 4080);
+	// Rename the ds64 chunk, after the 12 byte header, so it's skipped
+	memcpy(&image[12], "junk", 4);
+	WAV_Reader reader;
+	CHECK_EQ(Audio_WAV_ParseImage(&reader, image.data(), image.size()), (long) WAV_ERR_CHUNK_SIZE);
+}
+
+TEST(wav_bext_time_reference) {
+	WAV_Reader reader;
+	CHECK_EQ(Audio_WAV_OpenReader(&reader, "fixtures/bext.wav"), 0L);
+	CHECK_EQ(reader.frameRate, 48000);
+	CHECK_EQ(reader.numFrames, 100LL);
+	CHECK_EQ(reader.timeReference, 5ULL * (1ULL << 32) + 17);
+	checkRamp(reader);
+	Audio_WAV_CloseReader(&reader);
+}
+
+// The pad byte after an odd-sized chunk is skipped, and a stray byte after
+// the last whole frame of the data counts as truncation
+TEST(wav_odd_chunk_padding) {
+	WAV_Reader reader;
+	CHECK_EQ(Audio_WAV_OpenReader(&reader, "fixtures/odd_chunk.wav"), 0L);
+	CHECK_EQ(reader.samplesPerFrame, 1);
+	CHECK_EQ(reader.numFrames, 50LL);
+	CHECK(reader.truncated);
+	checkRamp(reader);
+	Audio_WAV_CloseReader(&reader);
+}
+
+TEST(wav_truncated_data) {
+	WAV_Reader reader;
+	CHECK_EQ(Audio_WAV_OpenReader(&reader, "fixtures/truncated.wav"), 0L);
+	CHECK(reader.truncated);
+	CHECK_EQ(reader.numFrames, 400LL);
+	checkRamp(reader);
+	Audio_WAV_CloseReader(&reader);
+}
+
+TEST(wav_unfinalized_header) {
+	WAV_Reader reader;
+	CHECK_EQ(Audio_WAV_OpenReader(&reader, "fixtures/unfinalized.wav"), 0L);
+	CHECK(reader.truncated);
+	CHECK_EQ(reader.numFrames, 300LL);
+	checkRamp(reader);
+	Audio_WAV_CloseReader(&reader);
+}
+
+// Files cut off before the data chunk, or with a chunk running past the end,
+// are rejected
+TEST(wav_cut_in_header) {
+	std::ifstream in("fixtures/bext.wav", std::ios::binary);
+	std::vector<unsigned char> image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	WAV_Reader reader;
+	CHECK_EQ(Audio_WAV_ParseImage(&reader, image.data(), 8), (long) WAV_ERR_TRUNCATED);
+	CHECK_EQ(Audio_WAV_ParseImage(&reader, image.data(), 36), (long) WAV_ERR_TRUNCATED);
+	CHECK_EQ(Audio_WAV_ParseImage(&reader, image.data(), 300), (long) WAV_ERR_CHUNK_SIZE);
+	CHECK_EQ(Audio_WAV_ParseImage(&reader, image.data(), image.size()), 0L);
+}